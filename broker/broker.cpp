@@ -2,8 +2,10 @@
 #include <netinet/in.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 
 #include <algorithm>
 #include <cerrno>
@@ -17,11 +19,47 @@
 #include <vector>
 #include <sstream>
 #include <ctime>
+#include <csignal>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "priority_lanes.h"
+#include "../common/shm_ring.h"
+#include "../common/batch_codec.h"
+#include "replication.h"
+#include "monitor.h"
+#include "timing_wheel.h"
+#include "spill_store.h"
+#include "../common/clock.h"
+#include "../common/low_latency.h"
+#include "../common/trace.h"
 
 // Broker with fault tolerance: tracks message IDs, logs to disk, requeues on consumer failure.
-// - Append-only log: broker_log.txt (format: msgID|transaction_data)
+// - Append-only log: broker_log.txt or --log FILE (format: msgID|transaction_data)
 // - On startup: replays unacked messages from log
 // - On consumer disconnect: requeues unacked messages
+// - Ready messages wait in priority lanes (see priority_lanes.h) so high-value
+//   transactions are not stuck behind a backlog of small ones
+// - Optional shared-memory transport for co-located consumers (--shm-socket)
+// - Optional hot standby: the primary ships its log to standbys (--replica-port),
+//   a standby (--standby-of) keeps the state in memory and takes over when the primary dies
+// - The HTTP monitor runs on its own thread and only sees published snapshots (monitor.h)
+// - Visibility timeout: every delivery gets a deadline in a timing wheel (timing_wheel.h);
+//   a message not ACKed in time goes back to its lane for another consumer. ACKs are
+//   idempotent, so a late ACK from the stalled consumer is counted and ignored
+// - Backlog memory is bounded (spill_store.h): past the budget payloads are served back
+//   from the log, past the hard limit producers are paused
+// - Publisher confirms (opt-in): a producer that opens with "CONFIRM <producer_id> <first_seq>"
+//   has its units (lines or batch frames) numbered from first_seq; the broker drops units
+//   it already logged and answers "C <seq>" once everything up to seq is fsynced to the log
+//   of this broker. A confirm does not wait for standbys: a unit confirmed just before a
+//   failover may not have reached the standby that takes over. An idle publisher gets its
+//   last "C <seq>" repeated every second as a keepalive
+// - Low-latency mode (--low-latency CPU, see low_latency.h): the event loop is pinned and
+//   spins instead of sleeping in select(), sockets busy-poll, and socket I/O goes through
+//   pre-faulted pool buffers instead of per-message strings
+// - Sampled tracing (--trace-sample N, see trace.h): spans for ingest, lane wait, send and
+//   time in flight until the ACK, written as Chrome trace JSON on SIGTERM/SIGINT
 
 static void set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -44,13 +82,77 @@ static int make_server(uint16_t port) {
     return fd;
 }
 
+// Unix socket used for the shared-memory consumer handshake and liveness
+static int make_unix_server(const std::string& path) {
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) { perror("socket"); return -1; }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) { std::cerr << "Socket path too long" << std::endl; close(fd); return -1; }
+    std::strcpy(addr.sun_path, path.c_str());
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); close(fd); return -1; }
+    if (listen(fd, 16) < 0) { perror("listen"); close(fd); return -1; }
+    return fd;
+}
+
+// One outstanding delivery; epoch tells a stale delivery from the message's current one
+struct Delivery {
+    uint64_t id;
+    uint32_t epoch;
+};
+
+// A producer connection in confirm mode
+struct Publisher {
+    uint64_t id;           // producer id, stable across its reconnects
+    uint64_t seq;          // sequence number of the last unit read on this connection
+    uint64_t marked;       // highest sequence written as a log mark for this connection
+    uint64_t confirmed;    // highest sequence confirmed to it
+    std::string outbuf;    // unsent tail of the last confirm
+};
+
+// A sampled message while it is in the broker (see trace.h)
+struct TracedMessage {
+    uint64_t trace_id;
+    int64_t since_ns;      // when it entered its current stage: waiting in a lane, or in flight
+};
+
+// SIGTERM/SIGINT leave the main loop so shutdown runs the cleanup and exit handlers
+static volatile sig_atomic_t stop_requested = 0;
+
+static void request_stop(int) {
+    stop_requested = 1;
+}
+
 // HTTP monitoring support
+
 static std::string build_json_status(const std::set<int>& producers, const std::vector<int>& consumers, 
-                                     uint64_t total_messages, const std::map<int, std::queue<uint64_t>>& pending,
-                                     const std::map<int, uint64_t>& consumer_counts) {
+                                     uint64_t total_messages, uint64_t total_acked, const PriorityLanes& lanes,
+                                     const std::map<int, std::queue<Delivery>>& pending,
+                                     const std::map<int, uint64_t>& consumer_counts,
+                                     uint64_t redelivered, uint64_t duplicate_acks,
+                                     const SpillStore& spill, bool producers_paused,
+                                     uint64_t duplicate_units) {
     std::ostringstream json;
     json << "{\n";
-    json << "  \"broker\": {\"active\": true, \"total_messages\": " << total_messages << "},\n";
+    json << "  \"broker\": {\"active\": true, \"total_messages\": " << total_messages
+         << ", \"total_acked\": " << total_acked << ", \"queue_depth\": " << lanes.size()
+         << ", \"redelivered\": " << redelivered << ", \"duplicate_acks\": " << duplicate_acks
+         << ", \"duplicate_units_dropped\": " << duplicate_units << "},\n";
+    json << "  \"memory\": {\"resident_bytes\": " << spill.residentBytes()
+         << ", \"spilled\": " << spill.spilledCount() << ", \"backlog_bytes\": " << spill.memoryBytes()
+         << ", \"budget_bytes\": " << spill.budget() << ", \"hard_limit_bytes\": " << spill.hardLimit()
+         << ", \"producers_paused\": " << (producers_paused ? "true" : "false") << "},\n";
+
+    json << "  \"lanes\": [";
+    for (int l = 0; l < PriorityLanes::NUM_LANES; l++) {
+        if (l > 0) json << ",";
+        json << "\n    {\"name\": \"" << PriorityLanes::name(l) << "\", \"depth\": " << lanes.size(l)
+             << ", \"dispatched\": " << lanes.dispatched(l)
+             << ", \"avg_wait_ms\": " << lanes.avgWaitMs(l)
+             << ", \"p99_wait_ms\": " << lanes.waitPercentileMs(l, 0.99) << "}";
+    }
+    json << "\n  ],\n";
     
     json << "  \"producers\": [";
     bool first = true;
@@ -79,66 +181,179 @@ static std::string build_json_status(const std::set<int>& producers, const std::
     return json.str();
 }
 
-static void handle_http_request(int client_fd, const std::set<int>& producers, 
-                                const std::vector<int>& consumers, uint64_t total_messages,
-                                const std::map<int, std::queue<uint64_t>>& pending,
-                                const std::map<int, uint64_t>& consumer_counts) {
-    char buffer[1024];
-    ssize_t n = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
-    if (n <= 0) {
-        close(client_fd);
-        return;
-    }
-    buffer[n] = '\0';
-    
-    // Parse HTTP request (simple GET /status check)
-    std::string request(buffer);
-    if (request.find("GET /status") != std::string::npos) {
-        std::string json = build_json_status(producers, consumers, total_messages, pending, consumer_counts);
-        
-        std::ostringstream response;
-        response << "HTTP/1.1 200 OK\r\n";
-        response << "Content-Type: application/json\r\n";
-        response << "Access-Control-Allow-Origin: *\r\n";
-        response << "Content-Length: " << json.length() << "\r\n";
-        response << "Connection: close\r\n";
-        response << "\r\n";
-        response << json;
-        
-        std::string resp_str = response.str();
-        send(client_fd, resp_str.c_str(), resp_str.length(), 0);
-    }
-    
-    close(client_fd);
-}
-
 struct Message {
     uint64_t id;
-    std::string data;
-    bool acked;
+    std::string data;   // ACKed messages are erased, so everything here is unacked
+    int lane;
+    uint32_t epoch;     // bumped on every dispatch and requeue
+    int consumer;       // consumer holding the current delivery, -1 while queued
+    bool spilled;       // data is empty and must be read back from the log
+    SpillRef spill;
 };
 
 static std::ofstream log_file;
+static std::string log_path = "broker_log.txt";   // one per broker, so shards can share a directory
+static uint64_t log_offset = 0;    // bytes in broker_log.txt, including what is still buffered
+static uint64_t log_flushed = 0;   // log_offset at the last flush
 static uint64_t next_msg_id = 1;
+static ReplicaFeed replica_feed;   // standbys receive every log record as it is written
+static LaneClassifier classifier;
+static SpillStore spill;
+static int log_sync_fd = -1;       // for fdatasync; the ofstream does not expose its fd
+static bool marks_unsynced = false;   // producer marks written since the last fdatasync
+static std::map<uint64_t, uint64_t> producer_seqs;  // producer id -> highest unit sequence in the log
 
-static void log_message(uint64_t id, const std::string& data) {
+// Returns the log offset of data, so a spilled message can be read back
+static uint64_t log_message(uint64_t id, const std::string& data) {
+    std::string prefix = std::to_string(id) + "|0|";  // 0 = unacked
+    uint64_t data_offset = log_offset + prefix.size();
     if (log_file.is_open()) {
-        log_file << id << "|0|" << data << '\n';  // 0 = unacked
+        log_file << prefix << data << '\n';
+        log_offset += prefix.size() + data.size() + 1;
         // Don't flush - let OS buffer writes for performance
     }
+    if (replica_feed.standbys()) {
+        replica_feed.append(prefix + data + "\n");
+    }
+    return data_offset;
+}
+
+// One record for a whole producer batch; its messages take ids first_id, first_id+1, ...
+// Returns the log offset of the payload.
+static uint64_t log_batch(uint64_t first_id, const std::string& payload) {
+    std::string record = BatchCodec::logRecord(first_id, payload);
+    uint64_t payload_offset = log_offset + record.size() - payload.size() - 1;
+    if (log_file.is_open()) {
+        log_file << record;
+        log_offset += record.size();
+    }
+    if (replica_feed.standbys()) {
+        replica_feed.append(record);
+    }
+    return payload_offset;
+}
+
+// "P|<producer_id>|<seq>": every unit of that producer up to seq is in the log before this mark
+static void log_producer_seq(uint64_t producer_id, uint64_t seq) {
+    std::string mark = "P|" + std::to_string(producer_id) + "|" + std::to_string(seq) + "\n";
+    if (log_file.is_open()) {
+        log_file << mark;
+        log_offset += mark.size();
+        marks_unsynced = true;
+    }
+    if (replica_feed.standbys()) {
+        replica_feed.append(mark);
+    }
+}
+
+// Push everything up to the last producer mark to disk; publisher confirms are sent only
+// after this. Without new marks there is nothing a confirm would cover, so no fdatasync.
+static void sync_log() {
+    if (!marks_unsynced) return;
+    log_file.flush();
+    log_flushed = log_offset;
+    if (log_sync_fd >= 0) fdatasync(log_sync_fd);
+    marks_unsynced = false;
 }
 
 static void update_ack_status(uint64_t msg_id) {
     // For simplicity, we append an ACK marker to the log
     if (log_file.is_open()) {
-        log_file << msg_id << "|1|ACK" << '\n';  // 1 = acked
+        std::string marker = std::to_string(msg_id) + "|1|ACK\n";  // 1 = acked
+        log_file << marker;
+        log_offset += marker.size();
         // Don't flush - batch writes for performance
     }
+    if (replica_feed.standbys()) {
+        replica_feed.append(std::to_string(msg_id) + "|1|ACK\n");
+    }
+}
+
+// Add an unacked message; its payload is dropped from memory if the budget says so
+// (ref says where the log has it)
+static void store_message(std::map<uint64_t, Message>& msgs, uint64_t id, std::string data, const SpillRef& ref) {
+    auto it = msgs.find(id);
+    if (it != msgs.end()) spill.release(it->second.spilled, it->second.data.size());
+    Message& msg = msgs[id];
+    msg.id = id;
+    msg.lane = classifier.classify(data);
+    msg.epoch = 0;
+    msg.consumer = -1;
+    msg.spill = ref;
+    msg.spilled = !spill.admit(data.size());
+    if (msg.spilled) msg.data.clear();
+    else msg.data = std::move(data);
+}
+
+static void erase_message(std::map<uint64_t, Message>& msgs, std::map<uint64_t, Message>::iterator it) {
+    spill.release(it->second.spilled, it->second.data.size());
+    msgs.erase(it);
+}
+
+// Payload of a message, from memory or read back from the log
+static bool load_payload(const Message& msg, std::string& out) {
+    if (!msg.spilled) { out = msg.data; return true; }
+    if (msg.spill.offset + msg.spill.len > log_flushed) {
+        log_file.flush();
+        log_flushed = log_offset;
+    }
+    return spill.load(msg.spill, out);
+}
+
+// Apply one log record to the set of unacked messages; line_offset is where the line
+// starts in the log. Returns 0 for a message, 1 for an ACK marker, 2 for a producer
+// sequence mark, -1 for anything else.
+static int apply_log_record(const std::string& line, uint64_t line_offset, std::map<uint64_t, Message>& msgs) {
+    if (line.compare(0, 2, "P|") == 0) {
+        size_t bar = line.find('|', 2);
+        if (bar == std::string::npos) return -1;
+        uint64_t& seq = producer_seqs[std::stoull(line.substr(2, bar - 2))];
+        seq = std::max(seq, static_cast<uint64_t>(std::stoull(line.substr(bar + 1))));
+        return 2;
+    }
+    size_t pos1 = line.find('|');
+    if (pos1 == std::string::npos) return -1;
+    size_t pos2 = line.find('|', pos1 + 1);
+    if (pos2 == std::string::npos) return -1;
+    
+    uint64_t id = std::stoull(line.substr(0, pos1));
+    int acked = std::stoi(line.substr(pos1 + 1, pos2 - pos1 - 1));
+    std::string data = line.substr(pos2 + 1);
+    if (id >= next_msg_id) next_msg_id = id + 1;
+    
+    if (acked == 0) {
+        // Unacked message - add/keep it
+        SpillRef ref = {line_offset + pos2 + 1, static_cast<uint32_t>(data.size()), -1};
+        store_message(msgs, id, std::move(data), ref);
+        return 0;
+    }
+    if (acked == 1 && data == "ACK") {
+        // ACK marker - the message is done
+        auto it = msgs.find(id);
+        if (it != msgs.end()) erase_message(msgs, it);
+        return 1;
+    }
+    // Already acked message in log - ignore it
+    return -1;
+}
+
+// Apply a batch record's payload, which sits at payload_offset in the log.
+// Returns the number of messages, or -1 if it does not decode.
+static int apply_batch_record(uint64_t first_id, const char* payload, size_t len, uint64_t payload_offset,
+                              std::map<uint64_t, Message>& msgs) {
+    std::vector<std::string> lines;
+    if (!BatchCodec::decode(payload, len, lines)) return -1;
+    for (size_t i = 0; i < lines.size(); i++) {
+        SpillRef ref = {payload_offset, static_cast<uint32_t>(len), static_cast<int32_t>(i)};
+        store_message(msgs, first_id + i, std::move(lines[i]), ref);
+    }
+    if (first_id + lines.size() > next_msg_id) next_msg_id = first_id + lines.size();
+    return static_cast<int>(lines.size());
 }
 
 static std::map<uint64_t, Message> load_log() {
     std::map<uint64_t, Message> msgs;
-    std::ifstream infile("broker_log.txt");
+    std::ifstream infile(log_path);
     if (!infile.is_open()) {
         std::cout << "No previous log file found - starting fresh" << std::endl;
         return msgs;
@@ -148,116 +363,367 @@ static std::map<uint64_t, Message> load_log() {
     int total_lines = 0;
     int unacked_lines = 0;
     int ack_markers = 0;
+    int batches = 0;
+    uint64_t offset = 0;
     
     while (std::getline(infile, line)) {
         total_lines++;
-        size_t pos1 = line.find('|');
-        if (pos1 == std::string::npos) continue;
-        size_t pos2 = line.find('|', pos1 + 1);
-        if (pos2 == std::string::npos) continue;
-        
-        uint64_t id = std::stoull(line.substr(0, pos1));
-        int acked = std::stoi(line.substr(pos1 + 1, pos2 - pos1 - 1));
-        std::string data = line.substr(pos2 + 1);
-        
-        if (acked == 0) {
-            // Unacked message - add/keep it
-            msgs[id] = {id, data, false};
-            unacked_lines++;
-        } else if (acked == 1 && data == "ACK") {
-            // ACK marker - mark message as acked or remove it
-            ack_markers++;
-            if (msgs.count(id)) {
-                msgs[id].acked = true;
-            }
-        } else if (acked == 1) {
-            // Already acked message in log - ignore it
+        uint64_t line_offset = offset;
+        offset += line.size() + 1;
+        uint64_t first_id;
+        size_t len;
+        if (BatchCodec::parseLogHeader(line, first_id, len)) {
+            std::string payload(len + 1, '\0');
+            if (!infile.read(&payload[0], len + 1)) break;  // torn tail from a crash mid-write
+            int n = apply_batch_record(first_id, payload.data(), len, offset, msgs);
+            offset += len + 1;
+            if (n > 0) { batches++; unacked_lines += n; }
             continue;
         }
-        
-        if (id >= next_msg_id) next_msg_id = id + 1;
+        int kind = apply_log_record(line, line_offset, msgs);
+        if (kind == 0) unacked_lines++;
+        if (kind == 1) ack_markers++;
     }
     infile.close();
     
-    // Remove acked messages
-    std::vector<uint64_t> to_remove;
-    for (const auto& kv : msgs) {
-        if (kv.second.acked) {
-            to_remove.push_back(kv.first);
-        }
-    }
-    for (uint64_t id : to_remove) {
-        msgs.erase(id);
-    }
-    
     std::cout << "Log recovery: " << total_lines << " lines, " 
               << unacked_lines << " unacked messages, " 
-              << ack_markers << " ACK markers" << std::endl;
-    std::cout << "Loaded " << msgs.size() << " unacked messages from log" << std::endl;
+              << ack_markers << " ACK markers, " << batches << " batches" << std::endl;
+    std::cout << "Loaded " << msgs.size() << " unacked messages from log";
+    if (spill.spilledCount()) std::cout << " (" << spill.spilledCount() << " left on disk)";
+    std::cout << std::endl;
     std::cout << "Next message ID will be: " << next_msg_id << std::endl;
     return msgs;
 }
 
+// Start of the snapshot for a newly connected standby: header and producer sequence marks;
+// the unacked messages follow in chunks from fill_replica_snapshot
+static std::string replica_snapshot_header() {
+    std::string snap = "S|" + std::to_string(next_msg_id) + "\n";
+    for (const auto& kv : producer_seqs) {
+        snap += "P|" + std::to_string(kv.first) + "|" + std::to_string(kv.second) + "\n";
+    }
+    return snap;
+}
+
+// Next chunk of a standby's snapshot: unacked messages with ids in [cursor, end)
+static void fill_replica_snapshot(const std::map<uint64_t, Message>& messages, uint64_t& cursor, uint64_t end,
+                                  std::string& out, size_t max_bytes) {
+    std::string data;
+    auto it = messages.lower_bound(cursor);
+    for (; it != messages.end() && it->first < end && out.size() < max_bytes; ++it) {
+        if (!load_payload(it->second, data)) continue;
+        out += std::to_string(it->first) + "|0|" + data + "\n";
+    }
+    cursor = it != messages.end() && it->first < end ? it->first : end;
+}
+
+// Standby mode: mirror the primary's log into memory (and our own log file)
+// until the primary dies, so promotion needs no replay
+static void follow_primary(PrimaryFollower& primary, std::map<uint64_t, Message>& messages) {
+    std::string line;
+    uint64_t applied = 0;
+    while (primary.next(line)) {
+        if (line.compare(0, 2, "S|") == 0) {
+            // Fresh snapshot: the primary's state replaces whatever we had
+            messages.clear();
+            spill.clear();
+            producer_seqs.clear();
+            next_msg_id = std::stoull(line.substr(2));
+            log_file.close();
+            log_file.open(log_path, std::ios::trunc);
+            log_offset = log_flushed = 0;
+            std::cout << "Receiving snapshot from primary (next id " << next_msg_id << ")" << std::endl;
+            continue;
+        }
+        // Batch records arrive as "header\npayload"
+        size_t nl = line.find('\n');
+        uint64_t first_id;
+        size_t len;
+        if (nl != std::string::npos) {
+            if (!BatchCodec::parseLogHeader(line.substr(0, nl), first_id, len) ||
+                apply_batch_record(first_id, line.data() + nl + 1, len, log_offset + nl + 1, messages) < 0) continue;
+        } else if (apply_log_record(line, log_offset, messages) < 0) {
+            continue;
+        }
+        if (log_file.is_open()) {
+            log_file << line << '\n';
+            log_offset += line.size() + 1;
+        }
+        applied++;
+    }
+    log_file.flush();
+    std::cout << "Standby applied " << applied << " records; " << messages.size()
+              << " unacked messages in memory" << std::endl;
+}
+
 int main(int argc, char* argv[]) {
     uint16_t producer_port = 9100;
     uint16_t consumer_port = 9200;
     uint16_t monitor_port = 8081;  // HTTP monitoring port
-    if (argc >= 3) {
-        producer_port = static_cast<uint16_t>(std::stoi(argv[1]));
-        consumer_port = static_cast<uint16_t>(std::stoi(argv[2]));
+    PriorityLanes lanes;
+    std::string shm_path;              // empty = shared-memory transport disabled
+    size_t shm_ring_bytes = 1 << 20;
+    uint16_t replica_port = 0;         // 0 = no standbys accepted
+    std::string standby_host;          // non-empty = start as a standby of this primary
+    uint16_t standby_port = 0;
+    int64_t failover_ms = 500;
+    int64_t visibility_ms = 30000;     // 0 = deliveries never time out
+    size_t memory_budget_mb = 256;     // payload bytes kept in memory, 0 = unlimited
+    size_t memory_limit_mb = 1024;     // producers paused above this, 0 = never
+    int low_latency_cpu = -1;          // >= 0 = low-latency mode, event loop pinned to this core
+    int busy_poll_us = 50;             // SO_BUSY_POLL budget in low-latency mode
+    uint64_t trace_sample = 0;         // trace 1 in N messages, 0 = off
+    std::string trace_out = "broker.trace.json";
+
+    // Positional: <producer_port> <consumer_port> [monitor_port]; options may follow
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 2, "--") != 0) { positional.push_back(arg); continue; }
+        if (i + 1 >= argc) { std::cerr << "Missing value for " << arg << std::endl; return 1; }
+        std::string val = argv[++i];
+        if (arg == "--priority-amount") {
+            classifier.high_amount = std::stod(val);
+        } else if (arg == "--priority-merchants") {
+            std::istringstream ss(val);
+            std::string tok;
+            while (std::getline(ss, tok, ',')) classifier.high_merchants.insert(std::stoi(tok));
+        } else if (arg == "--lane-weights") {
+            size_t comma = val.find(',');
+            if (comma == std::string::npos) { std::cerr << "--lane-weights expects HIGH,NORMAL" << std::endl; return 1; }
+            lanes.setWeights(std::stoi(val.substr(0, comma)), std::stoi(val.substr(comma + 1)));
+        } else if (arg == "--shm-socket") {
+            shm_path = val;
+        } else if (arg == "--shm-ring-kb") {
+            shm_ring_bytes = std::stoul(val) * 1024;
+        } else if (arg == "--replica-port") {
+            replica_port = static_cast<uint16_t>(std::stoi(val));
+        } else if (arg == "--standby-of") {
+            size_t colon = val.rfind(':');
+            if (colon == std::string::npos) { std::cerr << "--standby-of expects HOST:PORT" << std::endl; return 1; }
+            standby_host = val.substr(0, colon);
+            standby_port = static_cast<uint16_t>(std::stoi(val.substr(colon + 1)));
+        } else if (arg == "--failover-timeout-ms") {
+            failover_ms = std::stoll(val);
+        } else if (arg == "--visibility-timeout-ms") {
+            visibility_ms = std::stoll(val);
+        } else if (arg == "--log") {
+            log_path = val;
+        } else if (arg == "--memory-budget-mb") {
+            memory_budget_mb = std::stoul(val);
+        } else if (arg == "--memory-limit-mb") {
+            memory_limit_mb = std::stoul(val);
+        } else if (arg == "--low-latency") {
+            low_latency_cpu = std::stoi(val);
+        } else if (arg == "--busy-poll-us") {
+            busy_poll_us = std::stoi(val);
+        } else if (arg == "--trace-sample") {
+            trace_sample = std::stoull(val);
+        } else if (arg == "--trace-out") {
+            trace_out = val;
+        } else if (arg == "--strict-priority") {
+            // Value is the starvation bound in ms for the normal lane
+            lanes.setPolicy(PriorityLanes::STRICT, std::stoll(val));
+        } else {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (positional.size() >= 2) {
+        producer_port = static_cast<uint16_t>(std::stoi(positional[0]));
+        consumer_port = static_cast<uint16_t>(std::stoi(positional[1]));
     }
-    if (argc >= 4) {
-        monitor_port = static_cast<uint16_t>(std::stoi(argv[3]));
+    if (positional.size() >= 3) {
+        monitor_port = static_cast<uint16_t>(std::stoi(positional[2]));
     }
 
     std::cout << "=== Fault-Tolerant Broker ===" << std::endl;
     std::cout << "Producer port: " << producer_port << ", Consumer port: " << consumer_port << std::endl;
-    std::cout << "Monitor port: " << monitor_port << " (HTTP status at /status)" << std::endl;
+    std::cout << "Monitor port: " << monitor_port << " (HTTP status at /status, SSE stream at /events)" << std::endl;
+    std::cout << "Priority lanes: high if amount >= " << classifier.high_amount
+              << (classifier.high_merchants.empty() ? "" : " or listed merchant")
+              << ", dispatch " << PriorityLanes::policyName(lanes.policy());
+    if (lanes.policy() == PriorityLanes::WEIGHTED) {
+        std::cout << " " << lanes.weight(PriorityLanes::HIGH) << ":" << lanes.weight(PriorityLanes::NORMAL);
+    }
+    std::cout << std::endl;
+    if (!shm_path.empty()) {
+        std::cout << "Shared-memory consumers: " << shm_path << " (" << shm_ring_bytes / 1024 << " KB rings)" << std::endl;
+    }
+    if (visibility_ms > 0) {
+        std::cout << "Visibility timeout: " << visibility_ms << " ms" << std::endl;
+    }
+    Trace::configure(trace_sample, "broker", Trace::MIDDLE, trace_out);
+    if (Trace::enabled()) {
+        std::cout << "Tracing 1 in " << trace_sample << " messages to " << trace_out << " (written at shutdown)" << std::endl;
+    }
 
     // Open log file for appending
-    log_file.open("broker_log.txt", std::ios::app);
+    log_file.open(log_path, std::ios::app);
     if (!log_file.is_open()) {
-        std::cerr << "Warning: Could not open broker_log.txt for writing" << std::endl;
+        std::cerr << "Warning: Could not open " << log_path << " for writing" << std::endl;
+    }
+    struct stat log_st;
+    if (stat(log_path.c_str(), &log_st) == 0) log_offset = log_flushed = static_cast<uint64_t>(log_st.st_size);
+    log_sync_fd = open(log_path.c_str(), O_WRONLY);
+    spill.configure(memory_budget_mb << 20, memory_limit_mb << 20);
+    if (memory_budget_mb && (!log_file.is_open() || !spill.open(log_path))) {
+        std::cerr << "Warning: no readable log, backlog payloads stay in memory" << std::endl;
+    }
+    if (spill.enabled()) {
+        std::cout << "Memory budget: " << memory_budget_mb << " MB of payloads, then spill to the log";
+        if (memory_limit_mb) std::cout << "; producers paused above " << memory_limit_mb << " MB";
+        std::cout << std::endl;
     }
 
     // Load unacked messages from previous run
     std::map<uint64_t, Message> messages = load_log();
-    std::queue<uint64_t> queue;  // queue of message IDs
-    for (auto& kv : messages) {
-        queue.push(kv.first);
+    if (!standby_host.empty()) {
+        std::cout << "Standby mode: following " << standby_host << ":" << standby_port
+                  << " (failover after " << failover_ms << " ms of silence)" << std::endl;
+        PrimaryFollower primary(standby_host, standby_port, failover_ms);
+        follow_primary(primary, messages);
+        std::cout << "Promoting standby to primary" << std::endl;
     }
+    for (auto& kv : messages) lanes.push(kv.second.lane, kv.first);
 
     int prod_listen = make_server(producer_port);
     int cons_listen = make_server(consumer_port);
     int monitor_listen = make_server(monitor_port);
     if (prod_listen < 0 || cons_listen < 0 || monitor_listen < 0) return 1;
+    MonitorServer monitor;
+    monitor.start(monitor_listen);
+    if (replica_port && !replica_feed.listen(replica_port)) return 1;
+    if (replica_feed.enabled()) {
+        std::cout << "Replication port: " << replica_port << std::endl;
+    }
+    // Socket buffers: pool blocks in low-latency mode, the stack otherwise
+    const size_t IO_BUF_BYTES = 65536;
+    char stack_buf[IO_BUF_BYTES];
+    char* buf = stack_buf;
+    char* send_buf = nullptr;
+    BufferPool io_pool;
+    bool low_latency = low_latency_cpu >= 0;
+    if (low_latency) {
+        // Pin only now: the monitor thread is already running and keeps the default affinity
+        std::string err;
+        if (!LowLatency::pinThread(low_latency_cpu, err)) {
+            std::cerr << "Cannot pin event loop to cpu " << low_latency_cpu << ": " << err << std::endl;
+            return 1;
+        }
+        if (!io_pool.init(IO_BUF_BYTES, 2)) { perror("mmap"); return 1; }
+        buf = io_pool.acquire();
+        send_buf = io_pool.acquire();
+        std::cout << "Low-latency mode: event loop pinned to cpu " << low_latency_cpu << ", busy-polling ("
+                  << busy_poll_us << " us), " << (io_pool.hugePages() ? "huge-page" : "pre-faulted")
+                  << " I/O buffers" << std::endl;
+    }
+    bool busy_poll_warned = false;
+    auto tune_socket = [&](int fd) {
+        if (!low_latency || LowLatency::busyPoll(fd, busy_poll_us) || busy_poll_warned) return;
+        std::cerr << "Warning: SO_BUSY_POLL refused (needs CAP_NET_ADMIN above net.core.busy_read), "
+                  << "spinning on non-blocking reads only" << std::endl;
+        busy_poll_warned = true;
+    };
+
+    int shm_listen = -1;
+    if (!shm_path.empty()) {
+        shm_listen = make_unix_server(shm_path);
+        if (shm_listen < 0) return 1;
+    }
 
     // State
     std::set<int> producers;           // connected producer sockets
     std::vector<int> consumers;        // connected consumer sockets
-    std::map<int, std::queue<uint64_t>> pending;   // consumer fd -> queue of pending message IDs
+    std::map<int, std::queue<Delivery>> pending;   // consumer fd -> deliveries in send order (ACKs are positional)
     std::map<int, uint64_t> consumer_counts;  // consumer fd -> messages received count
     size_t rr_index = 0;               // round-robin index
     std::map<int, std::string> inbuf;  // input buffers per socket
+    std::map<int, Publisher> publishers;     // producer fd -> confirm-mode state
+    std::map<int, ShmChannel> shm_channels;  // unix fd -> rings of a shared-memory consumer
     const size_t WINDOW_SIZE = 1000;    // Maximum pending messages per consumer (pipeline depth)
+    const int64_t CONFIRM_KEEPALIVE_NS = 1000 * 1000000LL;   // idle publishers hear from us this often
     
     // Stats for monitoring
     uint64_t total_dispatched = 0;
     uint64_t total_acked = 0;
     time_t last_stats_time = time(nullptr);
+    int64_t last_publish_ns = 0;
+    uint64_t total_redelivered = 0;
+    uint64_t duplicate_acks = 0;
+    bool producers_paused = false;
+    uint64_t duplicate_units = 0;      // units a confirm-mode producer resent after they were logged
+    int64_t last_confirm_keepalive_ns = Clock::monotonicNs();
+    std::string payload_buf;           // spilled payload read back for dispatch
+    std::unordered_map<uint64_t, TracedMessage> traced;   // msg id -> sampled message not yet ACKed
+    auto trace_ingest = [&](uint64_t msg_id, uint64_t trace_id, int64_t recv_ns) {
+        int64_t now = Clock::monotonicNs();
+        Trace::span("broker.ingest", trace_id, recv_ns, now);
+        traced[msg_id] = {trace_id, now};
+    };
+
+    // Standby snapshots are filled from the live message map as their sockets drain
+    ReplicaFeed::SnapshotFill fill_snapshot = [&](uint64_t& cursor, uint64_t end, std::string& out, size_t max_bytes) {
+        fill_replica_snapshot(messages, cursor, end, out, max_bytes);
+    };
+
+    // Delivery deadlines; 1 ms resolution is plenty for timeouts measured in seconds
+    TimingWheel deadlines(1000000, Clock::monotonicNs());
+    std::vector<TimingWheel::Timer> expired;
+    size_t finished_deliveries = 0;   // ACKed since the last purge; their timers are stale
+    // Consumers holding a delivery that timed out get nothing new until they ACK again
+    std::unordered_set<int> stalled;
+    // Messages too long for any shared-memory ring, held out of the lanes (still unacked in
+    // the log) until a TCP consumer connects
+    std::vector<uint64_t> oversized;
+
+    signal(SIGTERM, request_stop);
+    signal(SIGINT, request_stop);
 
     // Main loop using select()
-    while (true) {
+    while (!stop_requested) {
         fd_set rfds; FD_ZERO(&rfds);
         int maxfd = 0;
         FD_SET(prod_listen, &rfds); maxfd = std::max(maxfd, prod_listen);
         FD_SET(cons_listen, &rfds); maxfd = std::max(maxfd, cons_listen);
-        FD_SET(monitor_listen, &rfds); maxfd = std::max(maxfd, monitor_listen);
-        for (int p : producers) { FD_SET(p, &rfds); maxfd = std::max(maxfd, p); }
+        // Backpressure: above the hard limit producers are left unread until the backlog shrinks
+        if (spill.backpressure(producers_paused) != producers_paused) {
+            producers_paused = !producers_paused;
+            std::cout << (producers_paused ? "Memory limit reached: pausing producers" : "Resuming producers")
+                      << " (backlog " << (spill.memoryBytes() >> 20) << " MB)" << std::endl;
+        }
+        if (!producers_paused) {
+            for (int p : producers) { FD_SET(p, &rfds); maxfd = std::max(maxfd, p); }
+        }
         for (int c : consumers) { FD_SET(c, &rfds); maxfd = std::max(maxfd, c); }
 
-        timeval tv{1, 0};
-        int rv = select(maxfd + 1, &rfds, nullptr, nullptr, &tv);
+        // Wake up at least as often as the monitor snapshot is published
+        timeval tv{0, static_cast<suseconds_t>(MonitorServer::PUBLISH_INTERVAL_NS / 1000)};
+        fd_set wfds; FD_ZERO(&wfds);
+        replica_feed.addFds(rfds, wfds, maxfd);
+        if (replica_feed.standbys() && ReplicaFeed::HEARTBEAT_NS < MonitorServer::PUBLISH_INTERVAL_NS) {
+            tv = timeval{0, static_cast<suseconds_t>(ReplicaFeed::HEARTBEAT_NS / 1000)};  // keep heartbeats flowing
+        }
+        if (shm_listen >= 0) { FD_SET(shm_listen, &rfds); maxfd = std::max(maxfd, shm_listen); }
+        for (auto& kv : shm_channels) {
+            int efd = kv.second.to_broker.eventfd();
+            FD_SET(efd, &rfds); maxfd = std::max(maxfd, efd);
+            // ACKs already in the ring: poll instead of sleeping
+            if (!kv.second.to_broker.prepareWait()) tv = timeval{0, 0};
+        }
+        int64_t next_deadline_ns = deadlines.nextTimeoutNs(Clock::monotonicNs());
+        if (next_deadline_ns >= 0 && next_deadline_ns < tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL) {
+            tv = timeval{0, static_cast<suseconds_t>(next_deadline_ns / 1000)};
+        }
+        // Low-latency mode never sleeps: select() only polls, the loop spins
+        if (low_latency) tv = timeval{0, 0};
+
+        int rv = select(maxfd + 1, &rfds, &wfds, nullptr, &tv);
+        for (auto& kv : shm_channels) {
+            kv.second.to_broker.finishWait();
+            if (rv > 0 && FD_ISSET(kv.second.to_broker.eventfd(), &rfds)) kv.second.to_broker.drainWakeups();
+        }
         if (rv < 0) { if (errno == EINTR) continue; perror("select"); break; }
 
         // Accept new producers
@@ -266,6 +732,7 @@ int main(int argc, char* argv[]) {
             int fd = accept(prod_listen, (sockaddr*)&cli, &cl);
             if (fd >= 0) {
                 set_nonblocking(fd);
+                tune_socket(fd);
                 producers.insert(fd);
                 inbuf[fd] = std::string();
                 std::cout << "Producer connected: " << inet_ntoa(cli.sin_addr) << std::endl;
@@ -281,72 +748,213 @@ int main(int argc, char* argv[]) {
                 // Increase socket send buffer for better throughput
                 int sendbuf = 256 * 1024;  // 256 KB
                 setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sendbuf, sizeof(sendbuf));
+                tune_socket(fd);
                 consumers.push_back(fd);
                 inbuf[fd] = std::string();
                 consumer_counts[fd] = 0;  // Initialize message count
                 std::cout << "Consumer connected: " << inet_ntoa(cli.sin_addr) << std::endl;
+                if (!oversized.empty()) {
+                    std::cout << "Requeuing " << oversized.size() << " messages held for a TCP consumer" << std::endl;
+                    for (uint64_t id : oversized) {
+                        auto it = messages.find(id);
+                        if (it != messages.end()) lanes.push(it->second.lane, id);
+                    }
+                    oversized.clear();
+                }
             }
         }
 
-        // Accept HTTP monitoring requests
-        if (FD_ISSET(monitor_listen, &rfds)) {
-            sockaddr_in cli{}; socklen_t cl = sizeof(cli);
-            int fd = accept(monitor_listen, (sockaddr*)&cli, &cl);
+        // Accept shared-memory consumers: hand over a fresh ring pair on the unix socket
+        if (shm_listen >= 0 && FD_ISSET(shm_listen, &rfds)) {
+            int fd = accept(shm_listen, nullptr, nullptr);
             if (fd >= 0) {
-                handle_http_request(fd, producers, consumers, next_msg_id - 1, pending, consumer_counts);
+                ShmChannel ch;
+                if (ch.create(shm_ring_bytes) && ch.sendTo(fd)) {
+                    set_nonblocking(fd);
+                    consumers.push_back(fd);
+                    consumer_counts[fd] = 0;
+                    shm_channels[fd] = ch;
+                    std::cout << "Consumer connected: shared memory" << std::endl;
+                } else {
+                    perror("shm handshake");
+                    ch.close();
+                    close(fd);
+                }
             }
         }
 
+        // Accept standbys: they start from a snapshot of the unacked set
+        if (replica_feed.enabled() && FD_ISSET(replica_feed.listenFd(), &rfds)) {
+            replica_feed.accept(replica_snapshot_header(), next_msg_id);
+        }
+
         // Read from producers
         std::vector<int> to_close;
-        char buf[2048];
         for (int p : producers) {
             if (!FD_ISSET(p, &rfds)) continue;
-            ssize_t n = recv(p, buf, sizeof(buf), 0);
+            ssize_t n = recv(p, buf, IO_BUF_BYTES, 0);
             if (n <= 0) { to_close.push_back(p); continue; }
+            int64_t recv_ns = Trace::enabled() ? Clock::monotonicNs() : 0;
             std::string& b = inbuf[p];
             b.append(buf, buf + n);
+            auto pub = publishers.find(p);
+            // Parse from a read offset and drop the consumed prefix once per recv
+            size_t start = 0;
             size_t pos;
-            while ((pos = b.find('\n')) != std::string::npos) {
-                std::string line = b.substr(0, pos);
-                b.erase(0, pos + 1);
+            while ((pos = b.find('\n', start)) != std::string::npos) {
+                std::string line = b.substr(start, pos - start);
+                if (line.compare(0, 8, "CONFIRM ") == 0) {
+                    // Confirm mode: the next unit carries sequence number first_seq
+                    std::istringstream hello(line.substr(8));
+                    uint64_t producer_id = 0, first_seq = 1;
+                    hello >> producer_id >> first_seq;
+                    if (first_seq == 0) first_seq = 1;
+                    Publisher st = {producer_id, first_seq - 1, 0, first_seq - 1, std::string()};
+                    publishers[p] = st;
+                    pub = publishers.find(p);
+                    start = pos + 1;
+                    continue;
+                }
+                size_t frame_len;
+                bool is_frame = BatchCodec::parseFrameHeader(line, frame_len);
+                if (is_frame && b.size() < pos + 1 + frame_len) break;
+                size_t unit_end = is_frame ? pos + 1 + frame_len : pos + 1;
+                if (pub != publishers.end()) {
+                    // Units up to the producer's logged sequence are resends: already in the log
+                    uint64_t seq = ++pub->second.seq;
+                    uint64_t& logged = producer_seqs[pub->second.id];
+                    if (seq <= logged) {
+                        duplicate_units++;
+                        start = unit_end;
+                        continue;
+                    }
+                    logged = seq;
+                }
+                if (is_frame) {
+                    // Columnar batch: the whole payload is here, log it as one record
+                    const char* payload = b.data() + pos + 1;
+                    std::vector<std::string> batch;
+                    if (BatchCodec::decode(payload, frame_len, batch)) {
+                        uint64_t first_id = next_msg_id;
+                        uint64_t payload_offset = log_batch(first_id, std::string(payload, frame_len));
+                        for (size_t i = 0; i < batch.size(); i++) {
+                            uint64_t msg_id = next_msg_id++;
+                            SpillRef ref = {payload_offset, static_cast<uint32_t>(frame_len), static_cast<int32_t>(i)};
+                            uint64_t trace_id = Trace::enabled() ? Trace::idOf(batch[i]) : 0;
+                            store_message(messages, msg_id, std::move(batch[i]), ref);
+                            lanes.push(messages[msg_id].lane, msg_id);
+                            if (Trace::sampled(trace_id)) trace_ingest(msg_id, trace_id, recv_ns);
+                        }
+                    } else {
+                        std::cerr << "Dropping malformed batch of " << frame_len << " bytes" << std::endl;
+                    }
+                    start = unit_end;
+                    continue;
+                }
+                start = unit_end;
                 uint64_t msg_id = next_msg_id++;
-                messages[msg_id] = {msg_id, line, false};
-                log_message(msg_id, line);
-                queue.push(msg_id);
+                SpillRef ref = {log_message(msg_id, line), static_cast<uint32_t>(line.size()), -1};
+                uint64_t trace_id = Trace::enabled() ? Trace::idOf(line) : 0;
+                store_message(messages, msg_id, std::move(line), ref);
+                lanes.push(messages[msg_id].lane, msg_id);
+                if (Trace::sampled(trace_id)) trace_ingest(msg_id, trace_id, recv_ns);
                 // No ACK needed - TCP guarantees delivery
             }
+            b.erase(0, start);
         }
         for (int fd : to_close) {
             std::cout << "Producer disconnected" << std::endl;
-            close(fd); producers.erase(fd); inbuf.erase(fd);
+            close(fd); producers.erase(fd); inbuf.erase(fd); publishers.erase(fd);
+        }
+
+        // Publisher confirms: mark what each confirm-mode producer has in the log, make it
+        // durable with one fdatasync for all of them, then confirm cumulatively. An idle
+        // publisher gets its last confirm repeated as a keepalive, so a producer waiting
+        // on a paused or busy broker can tell it from a dead one.
+        int64_t confirm_now_ns = Clock::monotonicNs();
+        bool keepalive = confirm_now_ns - last_confirm_keepalive_ns >= CONFIRM_KEEPALIVE_NS;
+        if (keepalive) last_confirm_keepalive_ns = confirm_now_ns;
+        bool confirms_due = keepalive && !publishers.empty();
+        for (auto& kv : publishers) {
+            Publisher& pub = kv.second;
+            uint64_t logged = producer_seqs[pub.id];
+            if (logged > pub.marked) {
+                log_producer_seq(pub.id, logged);
+                pub.marked = logged;
+            }
+            if (logged > pub.confirmed || !pub.outbuf.empty()) confirms_due = true;
+        }
+        if (confirms_due) {
+            sync_log();
+            for (auto& kv : publishers) {
+                Publisher& pub = kv.second;
+                uint64_t logged = producer_seqs[pub.id];
+                // Confirms are cumulative: while one is stuck, later ones are folded into the next
+                if (pub.outbuf.empty() && logged > pub.confirmed) {
+                    pub.outbuf = "C " + std::to_string(logged) + "\n";
+                    pub.confirmed = logged;
+                } else if (pub.outbuf.empty() && keepalive) {
+                    pub.outbuf = "C " + std::to_string(pub.confirmed) + "\n";
+                }
+                if (pub.outbuf.empty()) continue;
+                ssize_t n = send(kv.first, pub.outbuf.data(), pub.outbuf.size(), MSG_NOSIGNAL);
+                if (n > 0) pub.outbuf.erase(0, n);
+            }
         }
 
         // Drain consumer input (parse ACKs)
+        auto handle_ack = [&](int c) {
+            if (!stalled.empty()) stalled.erase(c);
+            if (pending.count(c) && !pending[c].empty()) {
+                uint64_t msg_id = pending[c].front().id;
+                pending[c].pop();
+                // A redelivered message can be ACKed twice; only the first one counts.
+                // A late ACK from the original consumer is still a valid result, so it wins
+                // over the redelivered copy whatever the epoch.
+                auto it = messages.find(msg_id);
+                if (it == messages.end()) {
+                    duplicate_acks++;
+                    return;
+                }
+                // Done with it: drop the message so the backlog only holds unacked work
+                erase_message(messages, it);
+                update_ack_status(msg_id);  // Persist ACK to log
+                if (!traced.empty()) {
+                    auto tm = traced.find(msg_id);
+                    if (tm != traced.end()) {
+                        Trace::span("broker.in_flight", tm->second.trace_id, tm->second.since_ns, Clock::monotonicNs());
+                        traced.erase(tm);
+                    }
+                }
+                // Increment consumer message count
+                consumer_counts[c]++;
+                total_acked++;
+                finished_deliveries++;
+            }
+        };
+        std::string record;
+        for (auto& kv : shm_channels) {
+            while (kv.second.to_broker.tryRead(record)) {
+                if (record == "ACK" || record == "ERR") handle_ack(kv.first);
+            }
+        }
         to_close.clear();
         for (int c : consumers) {
             if (!FD_ISSET(c, &rfds)) continue;
-            ssize_t n = recv(c, buf, sizeof(buf), 0);
+            ssize_t n = recv(c, buf, IO_BUF_BYTES, 0);
             if (n <= 0) { to_close.push_back(c); continue; }
             std::string& b = inbuf[c];
             b.append(buf, buf + n);
+            size_t start = 0;
             size_t pos;
-            while ((pos = b.find('\n')) != std::string::npos) {
-                std::string line = b.substr(0, pos);
-                b.erase(0, pos + 1);
+            while ((pos = b.find('\n', start)) != std::string::npos) {
                 // Simple ACK: mark pending message as acked
-                if (line == "ACK" || line == "ERR") {
-                    if (pending.count(c) && !pending[c].empty()) {
-                        uint64_t msg_id = pending[c].front();
-                        pending[c].pop();
-                        messages[msg_id].acked = true;
-                        update_ack_status(msg_id);  // Persist ACK to log
-                        // Increment consumer message count
-                        consumer_counts[c]++;
-                        total_acked++;
-                    }
+                if (b.compare(start, pos - start, "ACK") == 0 || b.compare(start, pos - start, "ERR") == 0) {
+                    handle_ack(c);
                 }
+                start = pos + 1;
             }
+            b.erase(0, start);
         }
         for (int fd : to_close) {
             std::cout << "Consumer disconnected";
@@ -354,9 +962,14 @@ int main(int argc, char* argv[]) {
             if (pending.count(fd) && !pending[fd].empty()) {
                 std::cout << " (requeuing " << pending[fd].size() << " messages)";
                 while (!pending[fd].empty()) {
-                    uint64_t msg_id = pending[fd].front();
+                    Delivery d = pending[fd].front();
                     pending[fd].pop();
-                    queue.push(msg_id);
+                    // Deliveries that already timed out were requeued then
+                    auto it = messages.find(d.id);
+                    if (it == messages.end() || it->second.epoch != d.epoch) continue;
+                    it->second.epoch++;
+                    it->second.consumer = -1;
+                    lanes.push(it->second.lane, d.id);
                 }
                 pending.erase(fd);
             }
@@ -364,19 +977,54 @@ int main(int argc, char* argv[]) {
             close(fd);
             consumers.erase(std::remove(consumers.begin(), consumers.end(), fd), consumers.end());
             inbuf.erase(fd);
+            stalled.erase(fd);
             consumer_counts.erase(fd);  // Clean up message count
+            if (shm_channels.count(fd)) {
+                shm_channels[fd].close();
+                shm_channels.erase(fd);
+            }
             if (rr_index >= consumers.size()) rr_index = 0;
         }
 
+        // Requeue deliveries whose visibility timeout ran out. The stalled consumer keeps the
+        // slots in its window and is skipped by dispatch until it ACKs or disconnects, so the
+        // message cannot go straight back to it.
+        int64_t dispatch_ns = Clock::monotonicNs();
+        expired.clear();
+        deadlines.advance(dispatch_ns, expired);
+        size_t redelivered = 0;
+        for (const TimingWheel::Timer& t : expired) {
+            auto it = messages.find(t.id);
+            if (it == messages.end() || it->second.epoch != t.tag) continue;
+            it->second.epoch++;
+            if (it->second.consumer >= 0) stalled.insert(it->second.consumer);
+            it->second.consumer = -1;
+            lanes.push(it->second.lane, t.id);
+            redelivered++;
+        }
+        // Timers of deliveries that finished early linger until their deadline; sweep them
+        // out once they outnumber the live ones
+        if (finished_deliveries > 4096 && finished_deliveries > deadlines.size() / 2) {
+            deadlines.purge([&](uint64_t id, uint32_t tag) {
+                auto it = messages.find(id);
+                return it == messages.end() || it->second.epoch != tag;
+            });
+            finished_deliveries = 0;
+        }
+        if (redelivered) {
+            std::cout << "Visibility timeout: redelivering " << redelivered << " messages" << std::endl;
+            total_redelivered += redelivered;
+        }
+
         // Dispatch queued messages to consumers (round-robin with pipelining)
-        while (!queue.empty() && !consumers.empty()) {
+        while (!lanes.empty() && !consumers.empty()) {
             // Find next available consumer (one with room in their window)
             size_t checked = 0;
             int c = -1;
             while (checked < consumers.size()) {
                 int candidate = consumers[rr_index];
                 size_t pending_count = pending.count(candidate) ? pending[candidate].size() : 0;
-                if (pending_count < WINDOW_SIZE) {
+                if (pending_count < WINDOW_SIZE && (stalled.empty() || !stalled.count(candidate))) {
                     c = candidate;
                     break;
                 }
@@ -386,14 +1034,61 @@ int main(int argc, char* argv[]) {
             // All consumers' windows full? Wait for ACKs
             if (c == -1) break;
             
-            uint64_t msg_id = queue.front();
-            if (!messages.count(msg_id)) { queue.pop(); continue; }
+            int lane = lanes.next();
+            uint64_t msg_id = lanes.front(lane);
+            if (!messages.count(msg_id)) { lanes.discard(lane); continue; }
             Message& msg = messages[msg_id];
-            if (msg.acked) { queue.pop(); continue; }
+            const std::string* data = &msg.data;
+            if (msg.spilled) {
+                if (!load_payload(msg, payload_buf)) {
+                    std::cerr << "Cannot read spilled message " << msg_id << " back from the log" << std::endl;
+                    lanes.discard(lane);
+                    continue;
+                }
+                data = &payload_buf;
+            }
             
-            std::string line = msg.data;
-            line.push_back('\n');
-            ssize_t n = send(c, line.c_str(), line.size(), 0);
+            auto shm = shm_channels.find(c);
+            if (shm != shm_channels.end() && data->size() > shm->second.to_consumer.maxRecord()) {
+                // Never fits a shared-memory ring: hand it to a TCP consumer with room, wait
+                // for one to free up, or hold it until one connects if there are none
+                int tcp = -1;
+                bool any_tcp = false;
+                for (int candidate : consumers) {
+                    if (shm_channels.count(candidate)) continue;
+                    any_tcp = true;
+                    if (stalled.count(candidate)) continue;
+                    if ((pending.count(candidate) ? pending[candidate].size() : 0) < WINDOW_SIZE) { tcp = candidate; break; }
+                }
+                if (tcp < 0 && any_tcp) break;
+                if (tcp < 0) {
+                    std::cerr << "Message " << msg_id << " (" << data->size() << " bytes) exceeds the shared-memory ring record limit ("
+                              << shm->second.to_consumer.maxRecord() << " bytes); holding it until a TCP consumer connects" << std::endl;
+                    lanes.discard(lane);
+                    oversized.push_back(msg_id);
+                    continue;
+                }
+                c = tcp;
+                shm = shm_channels.end();
+            }
+
+            auto tm = traced.empty() ? traced.end() : traced.find(msg_id);
+            int64_t send_ns = tm != traced.end() ? Clock::monotonicNs() : 0;
+            ssize_t n;
+            if (shm != shm_channels.end()) {
+                // Ring records carry their own length, no newline framing
+                bool ok = shm->second.to_consumer.tryWrite(data->data(), static_cast<uint32_t>(data->size()));
+                if (!ok) errno = EAGAIN;
+                n = ok ? 1 : -1;
+            } else if (send_buf && data->size() < IO_BUF_BYTES) {
+                std::memcpy(send_buf, data->data(), data->size());
+                send_buf[data->size()] = '\n';
+                n = send(c, send_buf, data->size() + 1, 0);
+            } else {
+                std::string line = *data;
+                line.push_back('\n');
+                n = send(c, line.c_str(), line.size(), 0);
+            }
             if (n < 0) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     // Socket buffer full - try next consumer
@@ -409,12 +1104,37 @@ int main(int argc, char* argv[]) {
                 break;
             }
             if (n == 0) break; // Shouldn't happen but handle it
-            queue.pop();
-            pending[c].push(msg_id);
+            if (tm != traced.end()) {
+                int64_t sent_ns = Clock::monotonicNs();
+                Trace::span("broker.queue", tm->second.trace_id, tm->second.since_ns, send_ns);
+                Trace::span("broker.send", tm->second.trace_id, send_ns, sent_ns);
+                tm->second.since_ns = sent_ns;
+            }
+            lanes.pop(lane);
+            msg.epoch++;
+            msg.consumer = c;
+            pending[c].push({msg_id, msg.epoch});
+            if (visibility_ms > 0) {
+                deadlines.schedule(dispatch_ns + visibility_ms * 1000000LL, msg_id, msg.epoch);
+            }
             total_dispatched++;
             rr_index = (rr_index + 1) % consumers.size();
         }
+        // One wakeup per batch for parked shared-memory consumers
+        for (auto& kv : shm_channels) kv.second.to_consumer.notify();
+
+        // Ship this iteration's log records to standbys
+        replica_feed.flush(rfds, fill_snapshot);
         
+        // Hand the monitor thread a fresh snapshot; it never touches the live maps
+        int64_t now_ns = Clock::monotonicNs();
+        if (now_ns - last_publish_ns >= MonitorServer::PUBLISH_INTERVAL_NS) {
+            monitor.publish(build_json_status(producers, consumers, next_msg_id - 1, total_acked, lanes,
+                                              pending, consumer_counts, total_redelivered, duplicate_acks,
+                                              spill, producers_paused, duplicate_units));
+            last_publish_ns = now_ns;
+        }
+
         // Print periodic stats
         time_t now = time(nullptr);
         if (now - last_stats_time >= 5) {  // Every 5 seconds
@@ -424,8 +1144,16 @@ int main(int argc, char* argv[]) {
             }
             std::cout << "[Stats] Dispatched: " << total_dispatched 
                       << ", ACKed: " << total_acked
-                      << ", Queue: " << queue.size()
+                      << ", Queue: " << lanes.size()
+                      << " (high " << lanes.size(PriorityLanes::HIGH)
+                      << ", p99 wait " << lanes.waitPercentileMs(PriorityLanes::HIGH, 0.99) << "ms"
+                      << "; normal " << lanes.size(PriorityLanes::NORMAL)
+                      << ", p99 wait " << lanes.waitPercentileMs(PriorityLanes::NORMAL, 0.99) << "ms)"
                       << ", Pending: " << total_pending
+                      << ", Redelivered: " << total_redelivered
+                      << ", Duplicate ACKs: " << duplicate_acks
+                      << ", Spilled: " << spill.spilledCount()
+                      << ", Backlog: " << (spill.memoryBytes() >> 20) << " MB"
                       << ", Consumers: " << consumers.size() << std::endl;
             last_stats_time = now;
         }
@@ -436,7 +1164,8 @@ int main(int argc, char* argv[]) {
     for (int c : consumers) close(c);
     close(prod_listen);
     close(cons_listen);
-    close(monitor_listen);
+    if (shm_listen >= 0) { close(shm_listen); unlink(shm_path.c_str()); }
+    for (auto& kv : shm_channels) kv.second.close();
     log_file.close();
     return 0;
 }
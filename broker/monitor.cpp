@@ -0,0 +1,164 @@
+#include "monitor.h"
+#include "../common/clock.h"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+static const size_t MAX_CLIENTS = 64;
+static const size_t MAX_REQUEST_BYTES = 4096;
+static const size_t MAX_OUTBUF_BYTES = 1 << 20;       // an SSE client this far behind is dropped
+static const int64_t REQUEST_TIMEOUT_NS = 5 * 1000000000LL;
+
+struct MonitorClient {
+    int fd;
+    std::string inbuf;
+    std::string outbuf;
+    int64_t accepted_ns;
+    bool answered;           // request parsed and a response queued
+    bool streaming;          // /events subscriber: stays open and gets every new snapshot
+    uint64_t sent_version;
+};
+
+static std::string http_response(const std::string& status, const std::string& body) {
+    return "HTTP/1.1 " + status + "\r\n"
+           "Content-Type: application/json\r\n"
+           "Access-Control-Allow-Origin: *\r\n"
+           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+           "Connection: close\r\n"
+           "\r\n" + body;
+}
+
+// One SSE event; every line of the JSON becomes a "data:" line
+static std::string sse_event(const std::string& json) {
+    std::string out = "data: ";
+    for (char c : json) {
+        if (c == '\n') out += "\ndata: ";
+        else out.push_back(c);
+    }
+    out += "\n\n";
+    return out;
+}
+
+MonitorServer::~MonitorServer() {
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+    if (listen_fd_ >= 0) close(listen_fd_);
+}
+
+void MonitorServer::start(int listen_fd) {
+    listen_fd_ = listen_fd;
+    int flags = fcntl(listen_fd_, F_GETFL, 0);
+    if (flags >= 0) fcntl(listen_fd_, F_SETFL, flags | O_NONBLOCK);
+    std::atomic_store(&snapshot_, std::make_shared<const std::string>("{}"));
+    thread_ = std::thread(&MonitorServer::run, this);
+}
+
+void MonitorServer::publish(std::string json) {
+    std::atomic_store(&snapshot_, std::make_shared<const std::string>(std::move(json)));
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+void MonitorServer::run() {
+    std::vector<MonitorClient> clients;
+    std::vector<pollfd> fds;
+    while (!stop_.load(std::memory_order_relaxed)) {
+        fds.clear();
+        fds.push_back({listen_fd_, POLLIN, 0});
+        for (const auto& c : clients) {
+            short events = !c.answered || c.streaming ? POLLIN : 0;
+            if (!c.outbuf.empty()) events |= POLLOUT;
+            fds.push_back({c.fd, events, 0});
+        }
+        // Short timeout: new snapshots are picked up without any signalling from the event loop
+        int rv = poll(fds.data(), fds.size(), 50);
+        if (rv < 0 && errno != EINTR) break;
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept(listen_fd_, nullptr, nullptr)) >= 0) {
+                if (clients.size() >= MAX_CLIENTS) { close(fd); continue; }
+                int flags = fcntl(fd, F_GETFL, 0);
+                if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+                clients.push_back({fd, std::string(), std::string(), Clock::monotonicNs(), false, false, 0});
+            }
+        }
+
+        uint64_t version = version_.load(std::memory_order_acquire);
+        std::shared_ptr<const std::string> snap = std::atomic_load(&snapshot_);
+        int64_t now = Clock::monotonicNs();
+
+        for (size_t i = 0; i < clients.size(); i++) {
+            MonitorClient& c = clients[i];
+            bool drop = false;
+            // Clients accepted this round have no poll entry yet
+            short revents = i + 1 < fds.size() ? fds[i + 1].revents : 0;
+
+            bool eof = false;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) {
+                char buf[1024];
+                ssize_t n;
+                while ((n = recv(c.fd, buf, sizeof(buf), 0)) > 0) {
+                    if (!c.answered) c.inbuf.append(buf, n);
+                }
+                eof = n == 0;   // may be a half-close after a complete request: still answer it
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) drop = true;
+                if (c.inbuf.size() > MAX_REQUEST_BYTES) drop = true;
+            }
+
+            if (!drop && !c.answered) {
+                if (c.inbuf.find("\r\n\r\n") != std::string::npos || c.inbuf.find("\n\n") != std::string::npos) {
+                    c.answered = true;
+                    if (c.inbuf.compare(0, 11, "GET /status") == 0) {
+                        c.outbuf = http_response("200 OK", *snap);
+                    } else if (c.inbuf.compare(0, 11, "GET /events") == 0) {
+                        c.streaming = true;
+                        c.sent_version = version;
+                        c.outbuf = "HTTP/1.1 200 OK\r\n"
+                                   "Content-Type: text/event-stream\r\n"
+                                   "Cache-Control: no-cache\r\n"
+                                   "Access-Control-Allow-Origin: *\r\n"
+                                   "Connection: keep-alive\r\n"
+                                   "\r\n"
+                                   "retry: 1000\n\n" + sse_event(*snap);
+                    } else {
+                        c.outbuf = http_response("404 Not Found", "{}");
+                    }
+                    c.inbuf.clear();
+                } else if (eof || now - c.accepted_ns > REQUEST_TIMEOUT_NS) {
+                    drop = true;
+                }
+            }
+            if (eof && c.streaming) drop = true;
+
+            if (!drop && c.streaming && c.sent_version != version) {
+                c.outbuf += sse_event(*snap);
+                c.sent_version = version;
+                if (c.outbuf.size() > MAX_OUTBUF_BYTES) drop = true;
+            }
+
+            while (!drop && !c.outbuf.empty()) {
+                ssize_t n = send(c.fd, c.outbuf.data(), c.outbuf.size(), MSG_NOSIGNAL);
+                if (n > 0) { c.outbuf.erase(0, n); continue; }
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                drop = true;
+            }
+            if (!drop && c.answered && !c.streaming) {
+                // Done once the response is out; a client that will not take it gets the request timeout
+                if (c.outbuf.empty() || now - c.accepted_ns > REQUEST_TIMEOUT_NS) drop = true;
+            }
+
+            if (drop) {
+                close(c.fd);
+                c.fd = -1;
+            }
+        }
+        clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                     [](const MonitorClient& c) { return c.fd < 0; }),
+                      clients.end());
+    }
+    for (auto& c : clients) close(c.fd);
+}
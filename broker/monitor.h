@@ -0,0 +1,37 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+// HTTP monitor served from its own thread so dashboards can never stall dispatch.
+// - The event loop publishes an immutable JSON snapshot every PUBLISH_INTERVAL_NS
+//   by swapping a shared_ptr; the monitor thread only ever reads published snapshots
+// - GET /status returns the latest snapshot
+// - GET /events is a Server-Sent-Events stream that pushes each new snapshot
+// - All monitor sockets are non-blocking with bounded buffers; a client that stops
+//   reading or never finishes its request is dropped
+
+class MonitorServer {
+public:
+    MonitorServer() : listen_fd_(-1), version_(0), stop_(false) {}
+    ~MonitorServer();
+
+    // Take over a listening socket and start the monitor thread
+    void start(int listen_fd);
+
+    // Event loop side: replace the current snapshot
+    void publish(std::string json);
+
+    static const int64_t PUBLISH_INTERVAL_NS = 250 * 1000000LL;
+
+private:
+    void run();
+
+    int listen_fd_;
+    std::shared_ptr<const std::string> snapshot_;   // accessed only via std::atomic_load/store
+    std::atomic<uint64_t> version_;
+    std::atomic<bool> stop_;
+    std::thread thread_;
+};
@@ -0,0 +1,102 @@
+#include "priority_lanes.h"
+#include "../common/clock.h"
+#include <cstdlib>
+#include <cstring>
+
+int LaneClassifier::classify(const std::string& data) const {
+    // Fields: id|card|amount|timestamp|merchant|location
+    size_t p1 = data.find('|');
+    if (p1 == std::string::npos) return PriorityLanes::NORMAL;
+    size_t p2 = data.find('|', p1 + 1);
+    if (p2 == std::string::npos) return PriorityLanes::NORMAL;
+    double amount = std::strtod(data.c_str() + p2 + 1, nullptr);
+    if (amount >= high_amount) return PriorityLanes::HIGH;
+
+    if (!high_merchants.empty()) {
+        size_t p3 = data.find('|', p2 + 1);
+        size_t p4 = p3 == std::string::npos ? p3 : data.find('|', p3 + 1);
+        if (p4 != std::string::npos) {
+            int merchant = std::atoi(data.c_str() + p4 + 1);
+            if (high_merchants.count(merchant)) return PriorityLanes::HIGH;
+        }
+    }
+    return PriorityLanes::NORMAL;
+}
+
+PriorityLanes::PriorityLanes()
+    : policy_(WEIGHTED), starvation_ns_(100 * 1000000LL), current_(HIGH), credits_(0) {
+    weights_[HIGH] = 8;
+    weights_[NORMAL] = 1;
+    credits_ = weights_[HIGH];
+    std::memset(dispatched_, 0, sizeof(dispatched_));
+    std::memset(wait_sum_ms_, 0, sizeof(wait_sum_ms_));
+    std::memset(wait_hist_, 0, sizeof(wait_hist_));
+}
+
+void PriorityLanes::setWeights(int high, int normal) {
+    weights_[HIGH] = high > 0 ? high : 1;
+    weights_[NORMAL] = normal > 0 ? normal : 1;
+    credits_ = weights_[current_];
+}
+
+void PriorityLanes::setPolicy(Policy policy, int64_t starvation_ms) {
+    policy_ = policy;
+    starvation_ns_ = starvation_ms * 1000000LL;
+}
+
+void PriorityLanes::push(int lane, uint64_t id) {
+    lanes_[lane].push_back({id, Clock::monotonicNs()});
+}
+
+int PriorityLanes::next() {
+    if (empty()) return -1;
+
+    if (policy_ == STRICT) {
+        if (lanes_[HIGH].empty()) return NORMAL;
+        // Aging: a normal message that waited past the bound jumps the high lane
+        if (!lanes_[NORMAL].empty() &&
+            Clock::monotonicNs() - lanes_[NORMAL].front().enqueued_ns > starvation_ns_) {
+            return NORMAL;
+        }
+        return HIGH;
+    }
+
+    // Weighted round-robin: serve up to weights_[lane] messages before moving on
+    if (credits_ <= 0 || lanes_[current_].empty()) {
+        int other = current_ == HIGH ? NORMAL : HIGH;
+        if (!lanes_[other].empty() || lanes_[current_].empty()) {
+            current_ = other;
+        }
+        credits_ = weights_[current_];
+    }
+    return current_;
+}
+
+void PriorityLanes::pop(int lane) {
+    int64_t wait_ns = Clock::monotonicNs() - lanes_[lane].front().enqueued_ns;
+    lanes_[lane].pop_front();
+    if (policy_ == WEIGHTED && lane == current_) credits_--;
+
+    dispatched_[lane]++;
+    wait_sum_ms_[lane] += wait_ns / 1e6;
+    uint64_t us = wait_ns > 0 ? static_cast<uint64_t>(wait_ns / 1000) : 0;
+    int bucket = 0;
+    while (us > 0 && bucket < HIST_BUCKETS - 1) { us >>= 1; bucket++; }
+    wait_hist_[lane][bucket]++;
+}
+
+double PriorityLanes::avgWaitMs(int lane) const {
+    return dispatched_[lane] ? wait_sum_ms_[lane] / dispatched_[lane] : 0.0;
+}
+
+double PriorityLanes::waitPercentileMs(int lane, double p) const {
+    if (dispatched_[lane] == 0) return 0.0;
+    uint64_t target = static_cast<uint64_t>(p * dispatched_[lane]);
+    uint64_t seen = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        seen += wait_hist_[lane][b];
+        // Bucket b holds waits below 2^b microseconds; report its upper bound
+        if (seen > target) return (1ULL << b) / 1000.0;
+    }
+    return (1ULL << (HIST_BUCKETS - 1)) / 1000.0;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <set>
+#include <string>
+
+// Priority lanes for the broker's ready queue.
+// - Classifier routes each message to the high or normal lane by amount / merchant
+// - Dispatch is weighted round-robin (default) or strict priority with an aging bound
+//   so the normal lane is never starved
+// - Per-lane depth and queue-wait histograms for monitoring
+
+struct LaneClassifier {
+    double high_amount = 5000.0;       // amount >= this goes to the high lane
+    std::set<int> high_merchants;      // merchants always routed to the high lane
+
+    // data is a serialized Transaction (id|card|amount|timestamp|merchant|location)
+    int classify(const std::string& data) const;
+};
+
+class PriorityLanes {
+public:
+    enum Lane { HIGH = 0, NORMAL = 1, NUM_LANES = 2 };
+    enum Policy { WEIGHTED, STRICT };
+
+    PriorityLanes();
+
+    void setWeights(int high, int normal);
+    void setPolicy(Policy policy, int64_t starvation_ms);
+
+    void push(int lane, uint64_t id);
+    bool empty() const { return size() == 0; }
+    size_t size() const { return lanes_[HIGH].size() + lanes_[NORMAL].size(); }
+    size_t size(int lane) const { return lanes_[lane].size(); }
+
+    // Lane that dispatch should serve next, or -1 if all lanes are empty.
+    // Call front()/pop() on the returned lane; pop() consumes one unit of its weight.
+    int next();
+    uint64_t front(int lane) const { return lanes_[lane].front().id; }
+    void pop(int lane);
+    // Drop the front entry without dispatching it (already ACKed or gone): no weight is
+    // consumed and it does not count in the wait statistics
+    void discard(int lane) { lanes_[lane].pop_front(); }
+
+    // Queue-wait statistics (time from push to pop) per lane
+    uint64_t dispatched(int lane) const { return dispatched_[lane]; }
+    double avgWaitMs(int lane) const;
+    double waitPercentileMs(int lane, double p) const;
+
+    static const char* name(int lane) { return lane == HIGH ? "high" : "normal"; }
+    static const char* policyName(Policy p) { return p == STRICT ? "strict" : "weighted"; }
+    Policy policy() const { return policy_; }
+    int weight(int lane) const { return weights_[lane]; }
+
+private:
+    struct Entry {
+        uint64_t id;
+        int64_t enqueued_ns;
+    };
+    static const int HIST_BUCKETS = 40;  // log2 buckets of wait time in microseconds
+
+    std::deque<Entry> lanes_[NUM_LANES];
+    int weights_[NUM_LANES];
+    Policy policy_;
+    int64_t starvation_ns_;
+    int current_;
+    int credits_;
+
+    uint64_t dispatched_[NUM_LANES];
+    double wait_sum_ms_[NUM_LANES];
+    uint64_t wait_hist_[NUM_LANES][HIST_BUCKETS];
+};
@@ -0,0 +1,195 @@
+#include "replication.h"
+#include "../common/batch_codec.h"
+#include "../common/clock.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+
+bool ReplicaFeed::listen(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { perror("socket"); return false; }
+    int opt = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); close(fd); return false; }
+    if (::listen(fd, 4) < 0) { perror("listen"); close(fd); return false; }
+    listen_fd_ = fd;
+    return true;
+}
+
+void ReplicaFeed::addFds(fd_set& rfds, fd_set& wfds, int& maxfd) const {
+    if (listen_fd_ < 0) return;
+    FD_SET(listen_fd_, &rfds);
+    if (listen_fd_ > maxfd) maxfd = listen_fd_;
+    for (const auto& l : links_) {
+        FD_SET(l.fd, &rfds);
+        if (!l.outbuf.empty() || l.cursor < l.snapshot_end) FD_SET(l.fd, &wfds);
+        if (l.fd > maxfd) maxfd = l.fd;
+    }
+}
+
+int ReplicaFeed::accept(const std::string& header, uint64_t snapshot_end) {
+    sockaddr_in cli{}; socklen_t cl = sizeof(cli);
+    int fd = ::accept(listen_fd_, (sockaddr*)&cli, &cl);
+    if (fd < 0) return -1;
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    links_.push_back({fd, header, 0, snapshot_end, std::string(), header.size()});
+    std::cout << "Standby connected: " << inet_ntoa(cli.sin_addr) << " (streaming snapshot)" << std::endl;
+    return fd;
+}
+
+void ReplicaFeed::append(const std::string& record) {
+    for (auto& l : links_) {
+        if (l.cursor < l.snapshot_end) l.live += record;
+        else l.outbuf += record;
+    }
+}
+
+void ReplicaFeed::flush(const fd_set& rfds, const SnapshotFill& fill) {
+    if (links_.empty()) return;
+    int64_t now = Clock::monotonicNs();
+    bool heartbeat = now - last_send_ns_ >= HEARTBEAT_NS;
+
+    for (size_t i = 0; i < links_.size();) {
+        Link& l = links_[i];
+        bool dead = false;
+        if (FD_ISSET(l.fd, &rfds)) {
+            // Standbys never send data; readable means closed
+            char b;
+            if (recv(l.fd, &b, 1, 0) <= 0) dead = true;
+        }
+        // At most one snapshot chunk per pass keeps the event loop responsive
+        bool refilled = false;
+        bool beat = heartbeat && l.outbuf.empty();
+        size_t sent = 0;
+        while (!dead) {
+            if (sent == l.outbuf.size()) {
+                l.outbuf.clear();
+                sent = 0;
+                if (l.cursor < l.snapshot_end && !refilled) {
+                    fill(l.cursor, l.snapshot_end, l.outbuf, SNAPSHOT_CHUNK);
+                    l.snapshot_bytes += l.outbuf.size();
+                    refilled = true;
+                    if (l.cursor >= l.snapshot_end) {
+                        l.cursor = l.snapshot_end;
+                        std::cout << "Snapshot sent to standby (" << l.snapshot_bytes / 1024 << " KB)" << std::endl;
+                        l.outbuf += l.live;
+                        std::string().swap(l.live);
+                    }
+                    continue;
+                }
+                if (beat && l.cursor >= l.snapshot_end) l.outbuf = "H\n";
+                beat = false;
+                if (l.outbuf.empty()) break;
+            }
+            ssize_t n = send(l.fd, l.outbuf.data() + sent, l.outbuf.size() - sent, MSG_NOSIGNAL);
+            if (n > 0) { sent += n; continue; }
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            dead = true;
+        }
+        if (sent) l.outbuf.erase(0, sent);
+        if (!dead && l.outbuf.size() + l.live.size() > MAX_BACKLOG + SNAPSHOT_CHUNK) {
+            std::cout << "Standby fell too far behind; dropping it (it will resync on reconnect)" << std::endl;
+            dead = true;
+        }
+        if (dead) {
+            std::cout << "Standby disconnected" << std::endl;
+            close(l.fd);
+            links_.erase(links_.begin() + i);
+            continue;
+        }
+        i++;
+    }
+    if (heartbeat) last_send_ns_ = now;
+}
+
+PrimaryFollower::~PrimaryFollower() {
+    if (fd_ >= 0) close(fd_);
+}
+
+bool PrimaryFollower::connect() {
+    addrinfo hints{}, *result;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string port_str = std::to_string(port_);
+    if (getaddrinfo(host_.c_str(), port_str.c_str(), &hints, &result) != 0) return false;
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) { freeaddrinfo(result); return false; }
+    if (::connect(fd, result->ai_addr, result->ai_addrlen) < 0) {
+        freeaddrinfo(result);
+        close(fd);
+        return false;
+    }
+    freeaddrinfo(result);
+    fd_ = fd;
+    return true;
+}
+
+bool PrimaryFollower::next(std::string& line) {
+    while (true) {
+        if (fd_ < 0) {
+            if (connected_once_) return false;
+            if (!connect()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+                continue;
+            }
+            connected_once_ = true;
+            std::cout << "Following primary at " << host_ << ":" << port_ << std::endl;
+        }
+
+        size_t pos;
+        while ((pos = inbuf_.find('\n', in_pos_)) != std::string::npos) {
+            line.assign(inbuf_, in_pos_, pos - in_pos_);
+            uint64_t first_id;
+            size_t len;
+            if (BatchCodec::parseLogHeader(line, first_id, len)) {
+                // Batch record: hand back "header\npayload" once all of it has arrived
+                if (inbuf_.size() < pos + 1 + len + 1) break;
+                line.assign(inbuf_, in_pos_, pos + 1 + len - in_pos_);
+                in_pos_ = pos + 1 + len + 1;
+                return true;
+            }
+            in_pos_ = pos + 1;
+            if (line == "H") continue;
+            return true;
+        }
+
+        fd_set rfds; FD_ZERO(&rfds); FD_SET(fd_, &rfds);
+        timeval tv{static_cast<time_t>(failover_ns_ / 1000000000LL),
+                   static_cast<suseconds_t>((failover_ns_ % 1000000000LL) / 1000)};
+        int rv = select(fd_ + 1, &rfds, nullptr, nullptr, &tv);
+        if (rv < 0 && errno == EINTR) continue;
+        if (rv == 0) {
+            std::cout << "Primary silent for " << failover_ns_ / 1000000 << " ms" << std::endl;
+            close(fd_); fd_ = -1;
+            return false;
+        }
+        char buf[65536];
+        ssize_t n = rv > 0 ? recv(fd_, buf, sizeof(buf), 0) : -1;
+        if (n <= 0) {
+            std::cout << "Lost connection to primary" << std::endl;
+            close(fd_); fd_ = -1;
+            return false;
+        }
+        // Drop the consumed prefix once per receive rather than once per record
+        inbuf_.erase(0, in_pos_);
+        in_pos_ = 0;
+        inbuf_.append(buf, n);
+    }
+}
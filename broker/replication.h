@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <sys/select.h>
+#include <vector>
+
+// WAL shipping between a primary broker and hot standbys.
+// The stream reuses the broker_log.txt record format ("id|0|data", "id|1|ACK" and
+// "first_id|2|len" batch records followed by their payload),
+// framed by a snapshot header so a standby can join at any time:
+//   S|<next_msg_id>     start of snapshot (standby discards its state)
+//   <log lines>         every unacked message, then live records
+//   H                   heartbeat, sent when the primary has nothing else to say
+// The snapshot is streamed: the broker fills it SNAPSHOT_CHUNK bytes at a time from a
+// message id cursor as the standby's socket drains, so a standby joining during a large
+// (even spilled) backlog costs neither the whole backlog in memory nor a long stall.
+// Live records for that standby wait behind the snapshot, so it never sees an ACK
+// before the message it acknowledges.
+
+// Primary side: accepts standbys and fans out log records to them
+class ReplicaFeed {
+public:
+    ReplicaFeed() : listen_fd_(-1), last_send_ns_(0) {}
+
+    bool listen(uint16_t port);
+    bool enabled() const { return listen_fd_ >= 0; }
+    int listenFd() const { return listen_fd_; }
+    size_t standbys() const { return links_.size(); }
+
+    // Register read interest (to notice standby disconnects) and write interest for backlogs
+    void addFds(fd_set& rfds, fd_set& wfds, int& maxfd) const;
+
+    // Append snapshot records for the unacked messages with ids in [cursor, end) to out,
+    // advancing cursor, until out holds at least max_bytes or cursor reaches end
+    typedef std::function<void(uint64_t& cursor, uint64_t end, std::string& out, size_t max_bytes)> SnapshotFill;
+
+    // Accept a new standby: header starts its snapshot, and messages with ids below
+    // snapshot_end follow from the fill callback given to flush()
+    int accept(const std::string& header, uint64_t snapshot_end);
+
+    // Queue one log record for every standby
+    void append(const std::string& record);
+
+    // Push queued bytes without blocking, refilling snapshots as they drain; sends a
+    // heartbeat if the stream has been idle
+    void flush(const fd_set& rfds, const SnapshotFill& fill);
+
+    static const int64_t HEARTBEAT_NS = 100 * 1000000LL;
+    static const size_t SNAPSHOT_CHUNK = 1024 * 1024;
+
+private:
+    struct Link {
+        int fd;
+        std::string outbuf;
+        uint64_t cursor;     // next message id of the snapshot; == snapshot_end when done
+        uint64_t snapshot_end;
+        std::string live;    // records held back until the snapshot is through
+        uint64_t snapshot_bytes;
+    };
+    static const size_t MAX_BACKLOG = 64 * 1024 * 1024;  // drop a standby whose live backlog exceeds this
+
+    int listen_fd_;
+    int64_t last_send_ns_;
+    std::vector<Link> links_;
+};
+
+// Standby side: follows a primary's feed and reports when it is gone
+class PrimaryFollower {
+public:
+    PrimaryFollower(const std::string& host, uint16_t port, int64_t failover_ms)
+        : host_(host), port_(port), failover_ns_(failover_ms * 1000000LL), fd_(-1), connected_once_(false), in_pos_(0) {}
+    ~PrimaryFollower();
+
+    // Next record of the stream (heartbeats are consumed internally); a batch record comes
+    // back as its header line, '\n', then the payload.
+    // Returns false once the primary is considered dead: EOF, error, or silence past the failover timeout.
+    // Before the first successful connection it keeps retrying instead.
+    bool next(std::string& line);
+
+private:
+    bool connect();
+
+    std::string host_;
+    uint16_t port_;
+    int64_t failover_ns_;
+    int fd_;
+    bool connected_once_;
+    std::string inbuf_;
+    size_t in_pos_;         // start of the first unparsed record in inbuf_
+};
@@ -0,0 +1,90 @@
+#include "spill_store.h"
+#include "../common/batch_codec.h"
+#include <fcntl.h>
+#include <unistd.h>
+
+static const uint64_t NO_BATCH = ~0ULL;
+
+SpillStore::SpillStore()
+    : budget_(0), hard_limit_(0), resident_bytes_(0), resident_count_(0), spilled_count_(0),
+      fd_(-1), window_offset_(0), batch_offset_(NO_BATCH) {}
+
+SpillStore::~SpillStore() {
+    if (fd_ >= 0) close(fd_);
+}
+
+void SpillStore::configure(size_t budget_bytes, size_t hard_limit_bytes) {
+    budget_ = budget_bytes;
+    hard_limit_ = hard_limit_bytes;
+}
+
+bool SpillStore::open(const std::string& path) {
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    if (fd_ < 0) return false;
+    posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return true;
+}
+
+bool SpillStore::admit(size_t bytes) {
+    if (!enabled() || (spilled_count_ == 0 && resident_bytes_ + bytes <= budget_)) {
+        resident_bytes_ += bytes;
+        resident_count_++;
+        return true;
+    }
+    spilled_count_++;
+    return false;
+}
+
+void SpillStore::release(bool spilled, size_t bytes) {
+    if (spilled) {
+        if (spilled_count_ > 0) spilled_count_--;
+    } else {
+        resident_bytes_ -= bytes < resident_bytes_ ? bytes : resident_bytes_;
+        if (resident_count_ > 0) resident_count_--;
+    }
+}
+
+void SpillStore::clear() {
+    resident_bytes_ = 0;
+    resident_count_ = 0;
+    spilled_count_ = 0;
+    window_.clear();
+    window_offset_ = 0;
+    batch_offset_ = NO_BATCH;
+    batch_.clear();
+}
+
+// Make [offset, offset + len) available in the window, reading ahead past it
+bool SpillStore::fill(uint64_t offset, size_t len) {
+    if (offset >= window_offset_ && offset + len <= window_offset_ + window_.size()) return true;
+    size_t want = len > READ_AHEAD_BYTES ? len : READ_AHEAD_BYTES;
+    window_.resize(want);
+    size_t got = 0;
+    while (got < want) {
+        ssize_t n = pread(fd_, &window_[got], want - got, static_cast<off_t>(offset + got));
+        if (n <= 0) break;
+        got += static_cast<size_t>(n);
+    }
+    window_.resize(got);
+    window_offset_ = offset;
+    return got >= len;
+}
+
+bool SpillStore::load(const SpillRef& ref, std::string& out) {
+    if (fd_ < 0) return false;
+    if (ref.index < 0) {
+        if (!fill(ref.offset, ref.len)) return false;
+        out.assign(window_, static_cast<size_t>(ref.offset - window_offset_), ref.len);
+        return true;
+    }
+    if (ref.offset != batch_offset_) {
+        batch_offset_ = NO_BATCH;
+        if (!fill(ref.offset, ref.len)) return false;
+        batch_.clear();
+        if (!BatchCodec::decode(window_.data() + (ref.offset - window_offset_), ref.len, batch_)) return false;
+        batch_offset_ = ref.offset;
+    }
+    if (static_cast<size_t>(ref.index) >= batch_.size()) return false;
+    out = batch_[ref.index];
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Memory budget for the broker's backlog, with spill-to-disk.
+// - Payloads stay in memory while their total is under the budget
+// - Past it, new messages keep only id and log location in memory; dispatch reads the
+//   payload back from broker_log.txt, which already holds every message, with a large
+//   read-ahead window so a draining backlog turns into sequential reads
+// - Spilling continues until every spilled message is gone, then new messages are
+//   kept in memory again (otherwise old spilled and new resident messages would make
+//   the read-back pattern random)
+// - Past the hard limit the broker stops reading from producers (TCP backpressure)
+
+// Where a spilled payload lives in the log: a plain record's data, or message `index`
+// of the batch payload at `offset`
+struct SpillRef {
+    uint64_t offset;
+    uint32_t len;
+    int32_t index;      // -1 = plain record
+};
+
+class SpillStore {
+public:
+    SpillStore();
+    ~SpillStore();
+
+    // budget_bytes: payload bytes kept in memory (0 = unlimited)
+    // hard_limit_bytes: estimated backlog memory at which producers are paused (0 = never)
+    void configure(size_t budget_bytes, size_t hard_limit_bytes);
+    // Log file to serve spilled payloads from; spilling stays off if it cannot be opened
+    bool open(const std::string& path);
+
+    // Account for a new unacked message; false = do not keep its payload in memory
+    bool admit(size_t bytes);
+    // Account for a message leaving the backlog
+    void release(bool spilled, size_t bytes);
+    // Backlog emptied wholesale (standby snapshot); also drops the read-ahead window
+    void clear();
+
+    // Read a spilled payload back; false if the log does not have it
+    bool load(const SpillRef& ref, std::string& out);
+
+    bool enabled() const { return budget_ > 0 && fd_ >= 0; }
+    // Whether producers should be paused; once paused they resume 10% below the hard
+    // limit so a backlog hovering at the limit does not flap
+    bool backpressure(bool paused) const {
+        return hard_limit_ > 0 && memoryBytes() > (paused ? hard_limit_ - hard_limit_ / 10 : hard_limit_);
+    }
+    size_t residentBytes() const { return resident_bytes_; }
+    uint64_t spilledCount() const { return spilled_count_; }
+    size_t memoryBytes() const { return resident_bytes_ + (resident_count_ + spilled_count_) * ENTRY_BYTES; }
+    size_t budget() const { return budget_; }
+    size_t hardLimit() const { return hard_limit_; }
+
+    // Estimated memory per backlog entry besides its payload (map node, Message, lane entry)
+    static const size_t ENTRY_BYTES = 160;
+    static const size_t READ_AHEAD_BYTES = 4 << 20;
+
+private:
+    bool fill(uint64_t offset, size_t len);
+
+    size_t budget_;
+    size_t hard_limit_;
+    size_t resident_bytes_;
+    uint64_t resident_count_;
+    uint64_t spilled_count_;
+
+    int fd_;
+    std::string window_;            // read-ahead: log bytes starting at window_offset_
+    uint64_t window_offset_;
+    uint64_t batch_offset_;         // last decoded batch, reused while dispatch walks through it
+    std::vector<std::string> batch_;
+};
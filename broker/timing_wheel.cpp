@@ -0,0 +1,75 @@
+#include "timing_wheel.h"
+
+static const uint64_t SLOT_MASK = TimingWheel::SLOTS - 1;
+// Deadlines beyond what the top level spans are parked at its far end and re-placed on cascade
+static const uint64_t MAX_SPAN = (1ULL << (TimingWheel::SLOT_BITS * TimingWheel::LEVELS)) - 1;
+
+TimingWheel::TimingWheel(int64_t tick_ns, int64_t now_ns)
+    : tick_ns_(tick_ns), origin_ns_(now_ns), current_(0), size_(0) {}
+
+void TimingWheel::schedule(int64_t deadline_ns, uint64_t id, uint32_t tag) {
+    int64_t rel = deadline_ns - origin_ns_;
+    // Round up so a timer never fires early; the current tick has already been processed
+    uint64_t tick = rel <= 0 ? 0 : static_cast<uint64_t>((rel + tick_ns_ - 1) / tick_ns_);
+    if (tick <= current_) tick = current_ + 1;
+    Timer t = {id, tag, tick};
+    place(t);
+}
+
+void TimingWheel::place(const Timer& t) {
+    uint64_t delta = t.deadline_tick - current_;
+    uint64_t target = t.deadline_tick;
+    if (delta > MAX_SPAN) target = current_ + MAX_SPAN;
+    int level = 0;
+    while (level < LEVELS - 1 && (target - current_) >= (1ULL << (SLOT_BITS * (level + 1)))) level++;
+    wheels_[level][(target >> (SLOT_BITS * level)) & SLOT_MASK].push_back(t);
+    size_++;
+}
+
+void TimingWheel::cascade(int level) {
+    std::vector<Timer> moving;
+    moving.swap(wheels_[level][(current_ >> (SLOT_BITS * level)) & SLOT_MASK]);
+    size_ -= moving.size();
+    for (const Timer& t : moving) place(t);
+}
+
+void TimingWheel::advance(int64_t now_ns, std::vector<Timer>& expired) {
+    if (now_ns <= origin_ns_) return;
+    uint64_t target = static_cast<uint64_t>((now_ns - origin_ns_) / tick_ns_);
+    while (current_ < target) {
+        if (size_ == 0) {
+            current_ = target;
+            break;
+        }
+        current_++;
+        // Each level that just wrapped pulls the next bucket of the level above down;
+        // highest first so timers can drop several levels in one tick
+        int wrapped = 1;
+        while (wrapped < LEVELS && ((current_ >> (SLOT_BITS * (wrapped - 1))) & SLOT_MASK) == 0) wrapped++;
+        for (int level = wrapped - 1; level >= 1; level--) cascade(level);
+
+        std::vector<Timer>& slot = wheels_[0][current_ & SLOT_MASK];
+        if (slot.empty()) continue;
+        std::vector<Timer> due;
+        due.swap(slot);
+        size_ -= due.size();
+        for (const Timer& t : due) {
+            if (t.deadline_tick <= current_) expired.push_back(t);
+            else place(t);
+        }
+    }
+}
+
+int64_t TimingWheel::nextTimeoutNs(int64_t now_ns) const {
+    if (size_ == 0) return -1;
+    // First occupied level-0 bucket, or the next cascade point if the near wheel is empty
+    uint64_t next = (current_ | SLOT_MASK) + 1;
+    for (uint64_t tick = current_ + 1; tick < current_ + SLOTS; tick++) {
+        if (!wheels_[0][tick & SLOT_MASK].empty()) {
+            next = tick;
+            break;
+        }
+    }
+    int64_t wait = origin_ns_ + static_cast<int64_t>(next) * tick_ns_ - now_ns;
+    return wait < 0 ? 0 : wait;
+}
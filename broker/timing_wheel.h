@@ -0,0 +1,73 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Hierarchical timing wheel (Varghese & Lauck) for per-delivery deadlines.
+// - LEVELS wheels of SLOTS buckets; level k buckets span SLOTS^k ticks
+// - schedule() is O(1): the timer goes into the coarsest bucket that still
+//   resolves its deadline and cascades down as the wheel turns
+// - No per-timer cancel: owners drop stale timers when they fire (the broker checks a
+//   per-message epoch), which keeps the hot path free of lookups. A timer whose work
+//   finished early still holds its 24 bytes until its deadline, so owners call purge()
+//   once stale timers outnumber live ones to keep memory proportional to live timers
+// - Idle stretches are skipped in one step when nothing is scheduled
+
+class TimingWheel {
+public:
+    struct Timer {
+        uint64_t id;
+        uint32_t tag;
+        uint64_t deadline_tick;
+    };
+
+    TimingWheel(int64_t tick_ns, int64_t now_ns);
+
+    void schedule(int64_t deadline_ns, uint64_t id, uint32_t tag);
+
+    // Move time forward to now_ns and append every timer that is due to expired
+    void advance(int64_t now_ns, std::vector<Timer>& expired);
+
+    size_t size() const { return size_; }
+
+    // Drop every timer for which stale(id, tag) is true; O(size) and returns the count dropped
+    template <typename Stale>
+    size_t purge(Stale stale);
+
+    // Upper bound on how long the caller may sleep without firing a timer late
+    // (-1 when nothing is scheduled)
+    int64_t nextTimeoutNs(int64_t now_ns) const;
+
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const uint64_t SLOTS = 1u << SLOT_BITS;
+
+private:
+    void place(const Timer& t);
+    void cascade(int level);
+
+    int64_t tick_ns_;
+    int64_t origin_ns_;
+    uint64_t current_;          // last tick processed
+    size_t size_;
+    std::vector<Timer> wheels_[LEVELS][SLOTS];
+};
+
+template <typename Stale>
+size_t TimingWheel::purge(Stale stale) {
+    size_t dropped = 0;
+    for (int level = 0; level < LEVELS; level++) {
+        for (uint64_t slot = 0; slot < SLOTS; slot++) {
+            std::vector<Timer>& bucket = wheels_[level][slot];
+            size_t kept = 0;
+            for (size_t i = 0; i < bucket.size(); i++) {
+                if (!stale(bucket[i].id, bucket[i].tag)) bucket[kept++] = bucket[i];
+            }
+            dropped += bucket.size() - kept;
+            bucket.resize(kept);
+            if (kept == 0) std::vector<Timer>().swap(bucket);
+        }
+    }
+    size_ -= dropped;
+    return dropped;
+}
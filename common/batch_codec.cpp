@@ -0,0 +1,283 @@
+#include "batch_codec.h"
+#include "clock.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+
+static const uint8_t BATCH_MAGIC = 'C';
+static const uint8_t BATCH_VERSION = 1;
+
+static void put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<char>((v & 0x7F) | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<char>(v));
+}
+
+static uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+static int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+static void put_string(std::string& out, const std::string& s) {
+    put_varint(out, s.size());
+    out.append(s);
+}
+
+struct Reader {
+    const char* p;
+    const char* end;
+    bool ok;
+
+    Reader(const char* begin, const char* stop) : p(begin), end(stop), ok(true) {}
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (p >= end) { ok = false; return 0; }
+            uint8_t b = static_cast<uint8_t>(*p++);
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        ok = false;
+        return 0;
+    }
+
+    std::string string() {
+        uint64_t n = varint();
+        if (!ok || static_cast<uint64_t>(end - p) < n) { ok = false; return std::string(); }
+        std::string s(p, n);
+        p += n;
+        return s;
+    }
+};
+
+// Epoch seconds -> "YYYY-MM-DDTHH:MM:SSZ". Timestamps are parsed with
+// Clock::parseIsoTimestamp, which only accepts text this prints back byte for byte.
+static void format_timestamp(int64_t secs, std::string& out) {
+    time_t tt = static_cast<time_t>(secs);
+    tm utc;
+    gmtime_r(&tt, &utc);
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%04d-%02d-%02dT%02d:%02d:%02dZ", utc.tm_year + 1900,
+                          utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec);
+    out.append(buf, n);
+}
+
+// Integer cents of an amount exactly as Transaction::serialize() prints it (fixed, two
+// decimals), so half-cent ties round the same way in both encodings. Amounts that do not
+// print as a plain number of at most 16 integer digits (non-finite, huge) have no cents
+// form and are stored as 0.
+static int64_t amount_cents(double amount) {
+    char buf[32];
+    int n = std::snprintf(buf, sizeof(buf), "%.2f", amount);
+    if (n <= 0 || n >= static_cast<int>(sizeof(buf))) return 0;
+    const char* p = buf;
+    bool negative = *p == '-';
+    if (negative) p++;
+    int64_t cents = 0;
+    int digits = 0;
+    for (; *p >= '0' && *p <= '9'; p++, digits++) cents = cents * 10 + (*p - '0');
+    if (digits == 0 || digits > 16 || p[0] != '.' || p[1] < '0' || p[1] > '9' || p[2] < '0' || p[2] > '9' || p[3]) return 0;
+    cents = cents * 100 + (p[1] - '0') * 10 + (p[2] - '0');
+    return negative ? -cents : cents;
+}
+
+std::string BatchCodec::encode(const std::vector<Transaction>& txns, size_t begin, size_t end) {
+    std::string out;
+    out.push_back(static_cast<char>(BATCH_MAGIC));
+    out.push_back(static_cast<char>(BATCH_VERSION));
+    put_varint(out, end - begin);
+
+    // Location dictionary, in first-seen order
+    std::map<std::string, uint64_t> dict;
+    std::vector<const std::string*> dict_order;
+    for (size_t i = begin; i < end; i++) {
+        if (dict.emplace(txns[i].location, dict.size()).second) dict_order.push_back(&txns[i].location);
+    }
+    put_varint(out, dict_order.size());
+    for (const std::string* s : dict_order) put_string(out, *s);
+
+    int64_t prev_id = 0;
+    for (size_t i = begin; i < end; i++) {
+        put_varint(out, zigzag(txns[i].transaction_id - prev_id));
+        prev_id = txns[i].transaction_id;
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        const std::string& card = txns[i].card_number;
+        bool digits = !card.empty() && card.size() <= 19;
+        uint64_t packed = 0;
+        for (size_t k = 0; digits && k < card.size(); k++) {
+            if (card[k] < '0' || card[k] > '9') digits = false;
+            else packed = packed * 10 + (card[k] - '0');
+        }
+        if (digits) {
+            put_varint(out, card.size() << 1);
+            put_varint(out, packed);
+        } else {
+            put_varint(out, 1);
+            put_string(out, card);
+        }
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        put_varint(out, zigzag(amount_cents(txns[i].amount)));
+    }
+
+    int64_t prev_secs = 0;
+    for (size_t i = begin; i < end; i++) {
+        int64_t secs;
+        if (Clock::parseIsoTimestamp(txns[i].timestamp, secs)) {
+            put_varint(out, zigzag(secs - prev_secs) << 1);
+            prev_secs = secs;
+        } else {
+            put_varint(out, 1);
+            put_string(out, txns[i].timestamp);
+        }
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        put_varint(out, zigzag(txns[i].merchant_id));
+    }
+
+    for (size_t i = begin; i < end; i++) {
+        put_varint(out, dict[txns[i].location]);
+    }
+    return out;
+}
+
+bool BatchCodec::decode(const char* data, size_t len, std::vector<std::string>& lines) {
+    Reader r(data, data + len);
+    if (len < 2 || static_cast<uint8_t>(data[0]) != BATCH_MAGIC || static_cast<uint8_t>(data[1]) != BATCH_VERSION) {
+        return false;
+    }
+    r.p += 2;
+    uint64_t n = r.varint();
+    if (!r.ok || n > len) return false;  // every row takes at least one byte per column
+
+    uint64_t dict_size = r.varint();
+    if (!r.ok || dict_size > len) return false;
+    std::vector<std::string> dict(dict_size);
+    for (auto& s : dict) s = r.string();
+
+    size_t base = lines.size();
+    lines.resize(base + n);
+
+    int64_t id = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        id += unzigzag(r.varint());
+        lines[base + i] = std::to_string(id);
+        lines[base + i].push_back('|');
+    }
+
+    char digits[24];
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t tag = r.varint();
+        std::string& line = lines[base + i];
+        if (tag & 1) {
+            line += r.string();
+        } else {
+            uint64_t count = tag >> 1;
+            uint64_t packed = r.varint();
+            if (count > 19) { lines.resize(base); return false; }
+            for (uint64_t k = count; k > 0; k--) {
+                digits[k - 1] = static_cast<char>('0' + packed % 10);
+                packed /= 10;
+            }
+            line.append(digits, count);
+        }
+        line.push_back('|');
+    }
+
+    char amount[32];
+    for (uint64_t i = 0; i < n; i++) {
+        int64_t cents = unzigzag(r.varint());
+        uint64_t mag = cents < 0 ? static_cast<uint64_t>(-cents) : static_cast<uint64_t>(cents);
+        int w = std::snprintf(amount, sizeof(amount), "%s%llu.%02llu", cents < 0 ? "-" : "",
+                              static_cast<unsigned long long>(mag / 100), static_cast<unsigned long long>(mag % 100));
+        lines[base + i].append(amount, w);
+        lines[base + i].push_back('|');
+    }
+
+    int64_t secs = 0;
+    int64_t formatted_secs = -1;
+    std::string formatted;
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t tag = r.varint();
+        std::string& line = lines[base + i];
+        if (tag & 1) {
+            line += r.string();
+        } else {
+            secs += unzigzag(tag >> 1);
+            // Timestamps repeat within a second; format each distinct value once
+            if (secs != formatted_secs) {
+                formatted.clear();
+                format_timestamp(secs, formatted);
+                formatted_secs = secs;
+            }
+            line += formatted;
+        }
+        line.push_back('|');
+    }
+
+    for (uint64_t i = 0; i < n; i++) {
+        lines[base + i] += std::to_string(unzigzag(r.varint()));
+        lines[base + i].push_back('|');
+    }
+
+    for (uint64_t i = 0; i < n; i++) {
+        uint64_t idx = r.varint();
+        if (idx >= dict.size()) { lines.resize(base); return false; }
+        lines[base + i] += dict[idx];
+    }
+
+    if (!r.ok) {
+        lines.resize(base);
+        return false;
+    }
+    return true;
+}
+
+std::string BatchCodec::frame(const std::string& payload) {
+    std::string out = "#B" + std::to_string(payload.size()) + "\n";
+    out += payload;
+    return out;
+}
+
+static bool parse_length(const std::string& s, size_t pos, size_t& len) {
+    if (pos >= s.size()) return false;
+    uint64_t v = 0;
+    for (size_t i = pos; i < s.size(); i++) {
+        if (s[i] < '0' || s[i] > '9') return false;
+        v = v * 10 + (s[i] - '0');
+        if (v > BatchCodec::MAX_BATCH_BYTES) return false;
+    }
+    len = static_cast<size_t>(v);
+    return true;
+}
+
+bool BatchCodec::parseFrameHeader(const std::string& line, size_t& len) {
+    if (line.size() < 3 || line[0] != '#' || line[1] != 'B') return false;
+    return parse_length(line, 2, len);
+}
+
+std::string BatchCodec::logRecord(uint64_t first_id, const std::string& payload) {
+    std::string out = std::to_string(first_id) + "|2|" + std::to_string(payload.size()) + "\n";
+    out += payload;
+    out.push_back('\n');
+    return out;
+}
+
+bool BatchCodec::parseLogHeader(const std::string& line, uint64_t& first_id, size_t& len) {
+    size_t bar = line.find('|');
+    if (bar == std::string::npos || bar == 0 || line.compare(bar, 3, "|2|") != 0) return false;
+    uint64_t id = 0;
+    for (size_t i = 0; i < bar; i++) {
+        if (line[i] < '0' || line[i] > '9') return false;
+        id = id * 10 + (line[i] - '0');
+    }
+    first_id = id;
+    return parse_length(line, bar + 3, len);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "transaction.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Columnar encoding for batches of transactions, used for producer -> broker
+// frames and for batch records in broker_log.txt.
+// Each column is stored contiguously:
+// - transaction_id: zigzag varint deltas
+// - card_number:    digits packed into one varint plus the digit count
+// - amount:         integer cents, zigzag varint
+// - timestamp:      epoch-second deltas (repeat within a second -> 1 byte)
+// - merchant_id:    varint
+// - location:       per-batch dictionary index
+// Values that do not fit a column's compact form (non-digit cards, unusual timestamps)
+// are escaped and stored verbatim, so decode reproduces Transaction::serialize(). Amounts
+// are the cents the text prints, so ties round alike; only an amount printing as -0.00,
+// a non-finite one, or one of 10^16 or more has no cents form and decodes differently.
+
+class BatchCodec {
+public:
+    // Encode txns[begin, end) into a self-contained batch
+    static std::string encode(const std::vector<Transaction>& txns, size_t begin, size_t end);
+
+    // Decode a batch straight into serialized lines (id|card|amount|timestamp|merchant|location).
+    // Returns false on malformed input.
+    static bool decode(const char* data, size_t len, std::vector<std::string>& lines);
+
+    // Producer stream framing: "#B<payload length>\n<payload>" between ordinary text lines
+    static std::string frame(const std::string& payload);
+    static bool parseFrameHeader(const std::string& line, size_t& len);
+
+    // Log/replication record for a batch whose messages got ids first_id, first_id+1, ...:
+    // "<first_id>|2|<payload length>\n<payload>\n"
+    static std::string logRecord(uint64_t first_id, const std::string& payload);
+    static bool parseLogHeader(const std::string& line, uint64_t& first_id, size_t& len);
+
+    // Largest frame payload the broker accepts; encoders must split batches below it
+    static const size_t MAX_BATCH_BYTES = 16 * 1024 * 1024;
+};
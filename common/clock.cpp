@@ -0,0 +1,56 @@
+#include "clock.h"
+#include <ctime>
+
+int64_t Clock::monotonicNs() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+const std::string& Clock::isoTimestamp() {
+    // Coarse clock is a vDSO read with no syscall; second resolution is all we format
+    thread_local time_t cached_sec = -1;
+    thread_local std::string cached;
+
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != cached_sec) {
+        // gmtime_r: reentrant, no global lock or TZ lookup, and matches the 'Z' suffix
+        tm utc;
+        gmtime_r(&ts.tv_sec, &utc);
+        char buf[32];
+        size_t len = strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", &utc);
+        cached.assign(buf, len);
+        cached_sec = ts.tv_sec;
+    }
+    return cached;
+}
+
+bool Clock::parseIsoTimestamp(const std::string& ts, int64_t& secs) {
+    if (ts.size() != 20 || ts[4] != '-' || ts[7] != '-' || ts[10] != 'T' ||
+        ts[13] != ':' || ts[16] != ':' || ts[19] != 'Z') return false;
+    static const int FIELD_POS[6] = {0, 5, 8, 11, 14, 17};
+    int v[6];
+    for (int k = 0; k < 6; k++) {
+        v[k] = 0;
+        for (int i = FIELD_POS[k]; i < FIELD_POS[k] + (k == 0 ? 4 : 2); i++) {
+            if (ts[i] < '0' || ts[i] > '9') return false;
+            v[k] = v[k] * 10 + (ts[i] - '0');
+        }
+    }
+    int y = v[0], m = v[1], d = v[2];
+    static const int MONTH_DAYS[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (m < 1 || m > 12 || d < 1 || d > MONTH_DAYS[m - 1] || v[3] > 23 || v[4] > 59 || v[5] > 59) return false;
+    bool leap = y % 4 == 0 && (y % 100 != 0 || y % 400 == 0);
+    if (m == 2 && d == 29 && !leap) return false;
+    // Days since 1970-01-01 in the proleptic Gregorian calendar, with March as the first
+    // month of the year so the leap day comes last; no libc call or locale/TZ lookup
+    y -= m <= 2;
+    int era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = y - era * 400;
+    int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = static_cast<int64_t>(era) * 146097 + doe - 719468;
+    secs = days * 86400 + v[3] * 3600 + v[4] * 60 + v[5];
+    return true;
+}
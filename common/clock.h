@@ -0,0 +1,18 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class Clock {
+public:
+    // Monotonic nanoseconds (CLOCK_MONOTONIC) for latency tagging;
+    // comparable across processes on the same host
+    static int64_t monotonicNs();
+
+    // UTC timestamp "YYYY-MM-DDTHH:MM:SSZ". The formatted string is cached per thread
+    // and only rebuilt when the second changes, so repeated calls are nearly free.
+    static const std::string& isoTimestamp();
+
+    // Parse that format back to seconds since the Unix epoch; false if ts is not in it or
+    // is not a real calendar time (Feb 30, second 60), so a parsed value formats back to ts
+    static bool parseIsoTimestamp(const std::string& ts, int64_t& secs);
+};
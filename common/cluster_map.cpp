@@ -0,0 +1,110 @@
+#include "cluster_map.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// FNV-1a with a final avalanche so short, similar keys still spread over the ring
+static uint64_t hash_key(const char* data, size_t len) {
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static bool parse_port(const std::string& s, uint16_t& port) {
+    if (s.empty() || s.size() > 5 || s.find_first_not_of("0123456789") != std::string::npos) return false;
+    unsigned long v = std::stoul(s);
+    if (v == 0 || v > 65535) return false;
+    port = static_cast<uint16_t>(v);
+    return true;
+}
+
+bool ClusterMap::addBroker(const std::string& name, const BrokerAddr& addr) {
+    if (name.empty() || addr.host.empty()) return false;
+    for (auto& s : shards_) {
+        if (s.name == name) { s.brokers.push_back(addr); return true; }
+    }
+    Shard s;
+    s.name = name;
+    s.brokers.push_back(addr);
+    shards_.push_back(s);
+    return true;
+}
+
+bool ClusterMap::load(const std::string& spec, std::string& error) {
+    shards_.clear();
+    std::ifstream in(spec);
+    if (in.is_open()) {
+        std::string line;
+        int line_no = 0;
+        while (std::getline(in, line)) {
+            line_no++;
+            size_t hash = line.find('#');
+            if (hash != std::string::npos) line.erase(hash);
+            std::istringstream ss(line);
+            std::string name, host, pport, cport;
+            if (!(ss >> name)) continue;
+            BrokerAddr addr;
+            if (!(ss >> host >> pport >> cport) || !parse_port(pport, addr.producer_port) ||
+                !parse_port(cport, addr.consumer_port)) {
+                error = spec + ":" + std::to_string(line_no) + ": expected <name> <host> <producer_port> <consumer_port>";
+                return false;
+            }
+            addr.host = host;
+            addBroker(name, addr);
+        }
+    } else {
+        std::istringstream ss(spec);
+        std::string entry;
+        while (std::getline(ss, entry, ',')) {
+            std::string name = "s" + std::to_string(shards_.size());
+            size_t eq = entry.find('=');
+            if (eq != std::string::npos) {
+                name = entry.substr(0, eq);
+                entry = entry.substr(eq + 1);
+            }
+            size_t c2 = entry.rfind(':');
+            size_t c1 = c2 == std::string::npos || c2 == 0 ? std::string::npos : entry.rfind(':', c2 - 1);
+            BrokerAddr addr;
+            if (c1 == std::string::npos || !parse_port(entry.substr(c1 + 1, c2 - c1 - 1), addr.producer_port) ||
+                !parse_port(entry.substr(c2 + 1), addr.consumer_port)) {
+                error = "bad cluster entry '" + entry + "' (expected [name=]host:producer_port:consumer_port, or a file)";
+                return false;
+            }
+            addr.host = entry.substr(0, c1);
+            if (!addBroker(name, addr)) { error = "bad cluster entry '" + entry + "'"; return false; }
+        }
+    }
+    if (shards_.empty()) {
+        error = "cluster map '" + spec + "' lists no brokers";
+        return false;
+    }
+    buildRing();
+    return true;
+}
+
+void ClusterMap::buildRing() {
+    ring_.clear();
+    for (size_t s = 0; s < shards_.size(); s++) {
+        for (int v = 0; v < VNODES; v++) {
+            std::string point = shards_[s].name + "#" + std::to_string(v);
+            ring_.push_back(std::make_pair(hash_key(point.data(), point.size()), static_cast<uint32_t>(s)));
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+size_t ClusterMap::shardFor(const std::string& key) const {
+    if (shards_.size() == 1) return 0;
+    uint64_t h = hash_key(key.data(), key.size());
+    auto it = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(h, static_cast<uint32_t>(0)));
+    if (it == ring_.end()) it = ring_.begin();
+    return it->second;
+}
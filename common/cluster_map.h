@@ -0,0 +1,50 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Static cluster map for running several independent brokers (shards).
+// - Each shard is one broker with its own log and recovery; optional standbys of
+//   that broker are listed after it under the same shard name
+// - Producers route by consistent hashing of the card number, so all transactions
+//   of a card go to the same shard, and adding a shard moves only ~1/n of the cards
+// - The map comes from a file, one broker per line:
+//       # name  host       producer_port  consumer_port
+//       s0      10.0.0.1   9100           9200
+//       s0      10.0.0.9   9100           9200      (standby of s0)
+//       s1      10.0.0.2   9100           9200
+//   or inline on the command line: "host:pport:cport,host:pport:cport" (shards s0, s1, ...)
+//   or "name=host:pport:cport,..."
+
+struct BrokerAddr {
+    std::string host;
+    uint16_t producer_port;
+    uint16_t consumer_port;
+};
+
+struct Shard {
+    std::string name;
+    std::vector<BrokerAddr> brokers;   // primary first, then its standbys
+};
+
+class ClusterMap {
+public:
+    // spec is a file path or an inline list; on failure error says why
+    bool load(const std::string& spec, std::string& error);
+
+    size_t size() const { return shards_.size(); }
+    const Shard& shard(size_t i) const { return shards_[i]; }
+
+    // Shard that owns this key (the card number)
+    size_t shardFor(const std::string& key) const;
+
+    static const int VNODES = 160;   // ring points per shard; more = more even split
+
+private:
+    bool addBroker(const std::string& name, const BrokerAddr& addr);
+    void buildRing();
+
+    std::vector<Shard> shards_;
+    std::vector<std::pair<uint64_t, uint32_t>> ring_;   // (point, shard), sorted by point
+};
@@ -0,0 +1,126 @@
+#include "low_latency.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+bool LowLatency::pinThread(int cpu, std::string& error) {
+    if (cpu < 0 || cpu >= CPU_SETSIZE) {
+        error = "cpu " + std::to_string(cpu) + " out of range";
+        return false;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        error = std::strerror(rc);
+        return false;
+    }
+    return true;
+}
+
+bool LowLatency::busyPoll(int fd, int usec) {
+#ifdef SO_BUSY_POLL
+    return setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) == 0;
+#else
+    (void)fd; (void)usec;
+    return false;
+#endif
+}
+
+BufferPool::BufferPool() : base_(nullptr), mapped_bytes_(0), block_bytes_(0), huge_(false) {}
+
+BufferPool::~BufferPool() {
+    if (base_) munmap(base_, mapped_bytes_);
+}
+
+bool BufferPool::init(size_t block_bytes, size_t blocks) {
+    if (base_ || block_bytes == 0 || blocks == 0) return false;
+    size_t bytes = block_bytes * blocks;
+    bytes = (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+    void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist if the admin reserved some (vm.nr_hugepages)
+    p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+    huge_ = p != MAP_FAILED;
+#endif
+    if (p == MAP_FAILED) {
+        p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (p == MAP_FAILED) return false;
+#ifdef MADV_HUGEPAGE
+        // Transparent huge pages, where enabled; the region is 2 MB-sized so it can be backed by them
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+    }
+    base_ = static_cast<char*>(p);
+    mapped_bytes_ = bytes;
+    block_bytes_ = block_bytes;
+    // MAP_POPULATE is best effort; touching every page guarantees nothing faults later.
+    // Locking is best effort too (RLIMIT_MEMLOCK), it only keeps the pages from being swapped.
+    for (size_t off = 0; off < bytes; off += 4096) base_[off] = 0;
+    mlock(base_, bytes);
+    free_.reserve(blocks);
+    for (size_t i = blocks; i > 0; i--) free_.push_back(base_ + (i - 1) * block_bytes);
+    return true;
+}
+
+char* BufferPool::acquire() {
+    if (free_.empty()) return nullptr;
+    char* block = free_.back();
+    free_.pop_back();
+    return block;
+}
+
+void BufferPool::release(char* block) {
+    if (block) free_.push_back(block);
+}
+
+LatencyHistogram::LatencyHistogram() : count_(0), max_ns_(0) {
+    std::memset(buckets_, 0, sizeof(buckets_));
+}
+
+int LatencyHistogram::bucketOf(uint64_t ns) {
+    if (ns < static_cast<uint64_t>(SUB_BUCKETS)) return static_cast<int>(ns);
+    int shift = 63 - __builtin_clzll(ns) - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) | static_cast<int>((ns >> shift) & (SUB_BUCKETS - 1));
+}
+
+uint64_t LatencyHistogram::bucketUpper(int bucket) {
+    if (bucket < SUB_BUCKETS) return static_cast<uint64_t>(bucket);
+    int shift = (bucket >> SUB_BITS) - 1;
+    uint64_t low = static_cast<uint64_t>(SUB_BUCKETS | (bucket & (SUB_BUCKETS - 1))) << shift;
+    return low + (1ULL << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t ns) {
+    if (ns < 0) ns = 0;
+    buckets_[bucketOf(static_cast<uint64_t>(ns))]++;
+    count_++;
+    if (ns > max_ns_) max_ns_ = ns;
+}
+
+int64_t LatencyHistogram::percentileNs(double p) const {
+    if (count_ == 0) return 0;
+    uint64_t rank = static_cast<uint64_t>(p * (count_ - 1) + 0.5) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += buckets_[b];
+        if (seen >= rank) {
+            int64_t upper = static_cast<int64_t>(bucketUpper(b));
+            return upper < max_ns_ ? upper : max_ns_;
+        }
+    }
+    return max_ns_;
+}
+
+std::string LatencyHistogram::summary() const {
+    char out[192];
+    std::snprintf(out, sizeof(out), "p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us (%llu samples)",
+                  percentileNs(0.50) / 1e3, percentileNs(0.90) / 1e3, percentileNs(0.99) / 1e3,
+                  percentileNs(0.999) / 1e3, max_ns_ / 1e3, static_cast<unsigned long long>(count_));
+    return out;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Opt-in low-latency mode shared by broker and consumer (--low-latency <cpu>).
+// - The hot thread is pinned to the configured core so it keeps its caches and is never
+//   migrated; threads started before pinning (monitor, HTTP) keep the default affinity
+// - Busy-polling: sockets get SO_BUSY_POLL and the event loop never parks in the kernel,
+//   it spins on non-blocking reads instead
+// - Receive and send buffers come from a BufferPool: one region, huge pages when the
+//   system has them, pre-faulted up front and carved into fixed-size blocks, so the
+//   message path neither allocates nor takes page faults
+// - LatencyHistogram records what the mode achieves, so runs with and without it compare
+
+namespace LowLatency {
+
+// Pin the calling thread to one CPU; on failure error says why
+bool pinThread(int cpu, std::string& error);
+
+// Ask the kernel to busy-poll the device queue for up to usec on reads of fd.
+// Values above net.core.busy_read need CAP_NET_ADMIN.
+bool busyPoll(int fd, int usec);
+
+}  // namespace LowLatency
+
+class BufferPool {
+public:
+    BufferPool();
+    ~BufferPool();
+
+    // Map and pre-fault blocks * block_bytes; false if the memory cannot be mapped
+    bool init(size_t block_bytes, size_t blocks);
+
+    // A free block, or nullptr when all are taken; never allocates
+    char* acquire();
+    void release(char* block);
+
+    size_t blockBytes() const { return block_bytes_; }
+    size_t mappedBytes() const { return mapped_bytes_; }
+    bool hugePages() const { return huge_; }
+
+    static const size_t HUGE_PAGE_BYTES = 2 << 20;
+
+private:
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+
+    char* base_;
+    size_t mapped_bytes_;
+    size_t block_bytes_;
+    bool huge_;
+    std::vector<char*> free_;
+};
+
+// Log-linear latency histogram: SUB_BUCKETS per power of two, so any percentile is
+// within 12.5% of the exact value, in a fixed 4 KB of counters
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(int64_t ns);
+
+    uint64_t count() const { return count_; }
+    int64_t maxNs() const { return max_ns_; }
+    // Upper bound of the bucket holding the p-th sample (p in [0, 1])
+    int64_t percentileNs(double p) const;
+
+    // "p50 12.1 us, p90 ..., p99 ..., p99.9 ..., max ... (N samples)"
+    std::string summary() const;
+
+private:
+    static const int SUB_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int BUCKETS = 64 * SUB_BUCKETS;
+
+    static int bucketOf(uint64_t ns);
+    static uint64_t bucketUpper(int bucket);
+
+    uint64_t buckets_[BUCKETS];
+    uint64_t count_;
+    int64_t max_ns_;
+};
@@ -0,0 +1,187 @@
+#include "shm_ring.h"
+#include <cstring>
+#include <new>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static uint64_t align8(uint64_t n) { return (n + 7) & ~uint64_t(7); }
+
+size_t ShmRing::footprint(size_t capacity) {
+    return align8(sizeof(Header)) + capacity;
+}
+
+void ShmRing::init(void* base, size_t capacity) {
+    Header* h = new (base) Header();
+    h->head.store(0);
+    h->tail.store(0);
+    h->reader_waiting.store(0);
+    h->capacity = capacity;
+}
+
+void ShmRing::bind(void* base, int eventfd) {
+    hdr_ = static_cast<Header*>(base);
+    data_ = static_cast<char*>(base) + align8(sizeof(Header));
+    efd_ = eventfd;
+}
+
+bool ShmRing::tryWrite(const char* data, uint32_t len) {
+    const uint64_t cap = hdr_->capacity;
+    const uint64_t need = align8(4 + static_cast<uint64_t>(len));
+    uint64_t tail = hdr_->tail.load(std::memory_order_relaxed);
+    uint64_t head = hdr_->head.load(std::memory_order_acquire);
+    uint64_t off = tail & (cap - 1);
+    uint64_t contiguous = cap - off;
+    uint64_t total = need > contiguous ? contiguous + need : need;
+    if (total > cap - (tail - head)) return false;
+
+    if (need > contiguous) {
+        // Not enough room before the end: mark the rest as skipped and start over at 0
+        std::memcpy(data_ + off, &WRAP, 4);
+        tail += contiguous;
+        off = 0;
+    }
+    std::memcpy(data_ + off, &len, 4);
+    std::memcpy(data_ + off + 4, data, len);
+    hdr_->tail.store(tail + need, std::memory_order_release);
+    return true;
+}
+
+uint32_t ShmRing::maxRecord() const {
+    // A record that does not fit before the end of the data area wraps to offset 0 and
+    // wastes the tail, so only half the capacity is guaranteed in one piece
+    uint64_t half = hdr_->capacity / 2;
+    uint64_t max = half > 4 ? half - 4 : 0;
+    return max < WRAP ? static_cast<uint32_t>(max) : WRAP - 1;
+}
+
+void ShmRing::notify() {
+    // Pairs with the fence in prepareWait(): either we see the flag or the reader sees our data
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (hdr_->reader_waiting.load(std::memory_order_relaxed)) {
+        eventfd_write(efd_, 1);
+    }
+}
+
+bool ShmRing::tryRead(std::string& out) {
+    const uint64_t cap = hdr_->capacity;
+    uint64_t head = hdr_->head.load(std::memory_order_relaxed);
+    uint64_t tail = hdr_->tail.load(std::memory_order_acquire);
+    if (head == tail) return false;
+
+    uint64_t off = head & (cap - 1);
+    uint32_t len;
+    std::memcpy(&len, data_ + off, 4);
+    if (len == WRAP) {
+        head += cap - off;
+        off = 0;
+        std::memcpy(&len, data_, 4);
+    }
+    out.assign(data_ + off + 4, len);
+    hdr_->head.store(head + align8(4 + static_cast<uint64_t>(len)), std::memory_order_release);
+    return true;
+}
+
+bool ShmRing::empty() const {
+    return hdr_->head.load(std::memory_order_relaxed) == hdr_->tail.load(std::memory_order_acquire);
+}
+
+bool ShmRing::prepareWait() {
+    hdr_->reader_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!empty()) {
+        hdr_->reader_waiting.store(0, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void ShmRing::finishWait() {
+    hdr_->reader_waiting.store(0, std::memory_order_relaxed);
+}
+
+void ShmRing::drainWakeups() {
+    eventfd_t drained;
+    eventfd_read(efd_, &drained);   // non-blocking fd: resets the counter
+}
+
+bool ShmChannel::create(size_t ring_bytes) {
+    size_t cap = 4096;
+    while (cap < ring_bytes) cap <<= 1;
+    size_t one = align8(ShmRing::footprint(cap));
+    size = 2 * one;
+
+    memfd = memfd_create("broker-shm-ring", MFD_CLOEXEC);
+    if (memfd < 0) return false;
+    if (ftruncate(memfd, static_cast<off_t>(size)) != 0) { close(); return false; }
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (base == MAP_FAILED) { base = nullptr; close(); return false; }
+
+    efd_consumer = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    efd_broker = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd_consumer < 0 || efd_broker < 0) { close(); return false; }
+
+    ShmRing::init(base, cap);
+    ShmRing::init(static_cast<char*>(base) + one, cap);
+    to_consumer.bind(base, efd_consumer);
+    to_broker.bind(static_cast<char*>(base) + one, efd_broker);
+    return true;
+}
+
+bool ShmChannel::attach(int mfd, int efd_c, int efd_b) {
+    memfd = mfd;
+    efd_consumer = efd_c;
+    efd_broker = efd_b;
+    off_t len = lseek(memfd, 0, SEEK_END);
+    if (len <= 0) return false;
+    size = static_cast<size_t>(len);
+    base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (base == MAP_FAILED) { base = nullptr; return false; }
+    to_consumer.bind(base, efd_consumer);
+    to_broker.bind(static_cast<char*>(base) + size / 2, efd_broker);
+    return true;
+}
+
+void ShmChannel::close() {
+    if (base) { munmap(base, size); base = nullptr; }
+    if (memfd >= 0) { ::close(memfd); memfd = -1; }
+    if (efd_consumer >= 0) { ::close(efd_consumer); efd_consumer = -1; }
+    if (efd_broker >= 0) { ::close(efd_broker); efd_broker = -1; }
+}
+
+bool ShmChannel::sendTo(int unix_fd) const {
+    int fds[3] = {memfd, efd_consumer, efd_broker};
+    char tag = 'S';
+    iovec iov{&tag, 1};
+    char ctrl[CMSG_SPACE(sizeof(fds))];
+    std::memset(ctrl, 0, sizeof(ctrl));
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    return sendmsg(unix_fd, &msg, MSG_NOSIGNAL) == 1;
+}
+
+bool ShmChannel::receiveFrom(int unix_fd) {
+    int fds[3];
+    char tag = 0;
+    iovec iov{&tag, 1};
+    char ctrl[CMSG_SPACE(sizeof(fds))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    if (recvmsg(unix_fd, &msg, MSG_CMSG_CLOEXEC) != 1 || tag != 'S') return false;
+    cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+    if (!cm || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds))) return false;
+    std::memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    return attach(fds[0], fds[1], fds[2]);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Shared-memory transport for consumers running on the same host as the broker.
+// - One memfd holds two single-producer/single-consumer byte rings:
+//   broker -> consumer (messages) and consumer -> broker (ACK/ERR)
+// - Records are [uint32 length][payload], 8-byte aligned, with a wrap marker at the end
+// - Wakeups use one eventfd per direction, written only when the reader is parked,
+//   so a busy reader costs no syscalls at all
+// - The handshake and liveness run over a Unix socket; when it closes the broker
+//   requeues pending messages exactly as for a TCP consumer
+
+class ShmRing {
+public:
+    ShmRing() : hdr_(nullptr), data_(nullptr), efd_(-1) {}
+
+    // Bind to a ring laid out at base (header followed by capacity bytes of data)
+    void bind(void* base, int eventfd);
+
+    // Writer side
+    bool tryWrite(const char* data, uint32_t len);
+    // Longest record that fits once the reader catches up, wherever the write position is;
+    // tryWrite() of anything longer fails every time
+    uint32_t maxRecord() const;
+    void notify();                       // wake the reader if it is parked
+
+    // Reader side
+    bool tryRead(std::string& out);
+    bool empty() const;
+    // Announce that the reader is about to block; returns false if data arrived meanwhile
+    bool prepareWait();
+    void finishWait();
+    void drainWakeups();                 // consume a signalled eventfd
+    int eventfd() const { return efd_; }
+
+    static size_t footprint(size_t capacity);
+    static void init(void* base, size_t capacity);
+
+private:
+    struct Header {
+        alignas(64) std::atomic<uint64_t> head;           // advanced by the reader
+        alignas(64) std::atomic<uint64_t> tail;           // advanced by the writer
+        alignas(64) std::atomic<uint32_t> reader_waiting;
+        uint64_t capacity;                                 // power of two, bytes
+    };
+    static const uint32_t WRAP = 0xFFFFFFFFu;
+
+    Header* hdr_;
+    char* data_;
+    int efd_;
+};
+
+struct ShmChannel {
+    ShmRing to_consumer;
+    ShmRing to_broker;
+    int memfd = -1;
+    int efd_consumer = -1;               // signalled when messages are ready for the consumer
+    int efd_broker = -1;                 // signalled when ACKs are ready for the broker
+    void* base = nullptr;
+    size_t size = 0;
+
+    // Broker side: allocate memfd + eventfds and initialise both rings
+    bool create(size_t ring_bytes);
+    // Consumer side: map the fds received from the broker
+    bool attach(int memfd, int efd_consumer, int efd_broker);
+    void close();
+
+    // Handshake helpers over a connected Unix socket (fds travel via SCM_RIGHTS)
+    bool sendTo(int unix_fd) const;
+    bool receiveFrom(int unix_fd);
+};
@@ -0,0 +1,138 @@
+#include "trace.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <unistd.h>
+
+struct SpanRecord {
+    const char* name;
+    uint64_t trace_id;
+    int64_t start_ns;
+    int64_t end_ns;
+};
+
+// One thread's spans; only that thread writes, dump() reads
+struct SpanRing {
+    SpanRecord spans[Trace::RING_SPANS];
+    std::atomic<uint64_t> head;   // spans ever recorded
+    int tid;
+};
+
+static std::mutex registry_mutex;
+static std::vector<SpanRing*> registry;      // rings live until exit so spans of finished threads are kept
+static thread_local SpanRing* thread_ring = nullptr;
+
+static std::string process_name;
+static std::string out_path;
+static Trace::Hop process_hop = Trace::MIDDLE;
+
+static SpanRing* ring_for_thread() {
+    if (!thread_ring) {
+        SpanRing* r = new SpanRing;
+        r->head.store(0, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        r->tid = static_cast<int>(registry.size()) + 1;
+        registry.push_back(r);
+        thread_ring = r;
+    }
+    return thread_ring;
+}
+
+static void dump_at_exit() {
+    Trace::dump();
+}
+
+// Chrome wants microseconds; print ns exactly instead of going through a double
+static void print_us(std::FILE* f, int64_t ns) {
+    std::fprintf(f, "%lld.%03lld", static_cast<long long>(ns / 1000), static_cast<long long>(ns % 1000));
+}
+
+uint64_t Trace::sample_every_ = 0;
+
+void Trace::configure(uint64_t sample_every, const std::string& name, Hop hop, const std::string& path) {
+    static bool registered = false;
+    sample_every_ = sample_every;
+    process_name = name;
+    process_hop = hop;
+    out_path = path;
+    if (sample_every_ && !registered) {
+        std::atexit(dump_at_exit);
+        registered = true;
+    }
+}
+
+uint64_t Trace::idOf(const char* data, size_t len) {
+    uint64_t id = 0;
+    for (size_t i = 0; i < len && data[i] >= '0' && data[i] <= '9'; i++) id = id * 10 + (data[i] - '0');
+    return id;
+}
+
+void Trace::span(const char* name, uint64_t trace_id, int64_t start_ns, int64_t end_ns) {
+    SpanRing* r = ring_for_thread();
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    SpanRecord& s = r->spans[h % RING_SPANS];
+    s.name = name;
+    s.trace_id = trace_id;
+    s.start_ns = start_ns;
+    s.end_ns = end_ns;
+    r->head.store(h + 1, std::memory_order_release);
+}
+
+bool Trace::dump() {
+    if (!enabled() || out_path.empty()) return false;
+    std::vector<SpanRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        rings = registry;
+    }
+    std::FILE* f = std::fopen(out_path.c_str(), "w");
+    if (!f) return false;
+    int pid = static_cast<int>(getpid());
+    std::fprintf(f, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"%s\"}}",
+                 pid, process_name.c_str());
+
+    // Earliest span of each message in this process anchors its flow arrow
+    struct Anchor { int64_t ts; int tid; };
+    std::unordered_map<uint64_t, Anchor> anchors;
+    std::vector<SpanRecord> copy;
+    size_t spans = 0;
+    for (SpanRing* r : rings) {
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t from = head > RING_SPANS ? head - RING_SPANS : 0;
+        copy.clear();
+        for (uint64_t i = from; i < head; i++) copy.push_back(r->spans[i % RING_SPANS]);
+        // The owner may still be recording: drop whatever it overwrote while we copied
+        uint64_t after = r->head.load(std::memory_order_acquire);
+        uint64_t valid_from = after > RING_SPANS ? after - RING_SPANS : 0;
+
+        std::fprintf(f, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s thread %d\"}}",
+                     pid, r->tid, process_name.c_str(), r->tid);
+        for (size_t k = 0; k < copy.size(); k++) {
+            if (from + k < valid_from) continue;
+            const SpanRecord& s = copy[k];
+            std::fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"msg\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":", s.name, pid, r->tid);
+            print_us(f, s.start_ns);
+            std::fprintf(f, ",\"dur\":");
+            print_us(f, s.end_ns - s.start_ns);
+            std::fprintf(f, ",\"args\":{\"trace_id\":%llu}}", static_cast<unsigned long long>(s.trace_id));
+            auto it = anchors.find(s.trace_id);
+            if (it == anchors.end() || s.start_ns < it->second.ts) anchors[s.trace_id] = {s.start_ns, r->tid};
+            spans++;
+        }
+    }
+
+    const char* phase = process_hop == FIRST ? "s" : process_hop == LAST ? "f" : "t";
+    for (const auto& kv : anchors) {
+        std::fprintf(f, ",\n{\"name\":\"message\",\"cat\":\"flow\",\"ph\":\"%s\",\"id\":%llu,\"pid\":%d,\"tid\":%d,\"ts\":",
+                     phase, static_cast<unsigned long long>(kv.first), pid, kv.second.tid);
+        print_us(f, kv.second.ts);
+        std::fprintf(f, "%s}", process_hop == FIRST ? "" : ",\"bp\":\"e\"");
+    }
+    std::fprintf(f, "\n]\n");
+    bool ok = std::fclose(f) == 0;
+    if (ok) std::fprintf(stderr, "Trace: %zu spans of %zu messages written to %s\n", spans, anchors.size(), out_path.c_str());
+    return ok;
+}
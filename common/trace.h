@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "clock.h"
+
+// Sampled per-message tracing (--trace-sample N, --trace-out FILE).
+// - The trace id is the transaction id. Every component samples the same ids (a hash
+//   of the id, 1 in N), so nothing extra travels on the wire and a sampled message has
+//   spans in the producer, the broker and the consumer
+// - Spans go into a fixed ring per thread with a single writer: no locks and no
+//   allocation when recording. A thread that records more than RING_SPANS spans keeps
+//   the newest
+// - Timestamps come from Clock::monotonicNs(), which all processes on a host share, so
+//   the files of different processes line up
+// - The file is Chrome trace-event JSON (a plain event array) written at exit. Flow
+//   events link the hops of one message across processes. Concatenate the arrays of
+//   all components (loadtest --trace-sample does it) and open the result in Perfetto
+//   or chrome://tracing
+// - With sampling off, sampled() is a load and a compare, and call sites skip
+//   extracting the id entirely behind enabled()
+
+class Trace {
+public:
+    // Hop of this process in the pipeline, for flow arrows: the first hop starts a flow,
+    // middle hops step it and the last one ends it
+    enum Hop { FIRST, MIDDLE, LAST };
+
+    // sample_every 0 = off. The file is written at exit and on dump().
+    static void configure(uint64_t sample_every, const std::string& process_name, Hop hop, const std::string& path);
+
+    static bool enabled() { return sample_every_ != 0; }
+    static bool sampled(uint64_t trace_id) {
+        return sample_every_ != 0 && trace_id != 0 && mix(trace_id) % sample_every_ == 0;
+    }
+
+    // Trace id of a serialized transaction: its leading transaction id, 0 if none
+    static uint64_t idOf(const char* data, size_t len);
+    static uint64_t idOf(const std::string& line) { return idOf(line.data(), line.size()); }
+
+    // Record a finished span; name must be a string literal
+    static void span(const char* name, uint64_t trace_id, int64_t start_ns, int64_t end_ns);
+
+    // Write every thread's spans to the configured file
+    static bool dump();
+
+    static const size_t RING_SPANS = 16384;   // per thread, 32 bytes each
+
+private:
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    static uint64_t sample_every_;
+};
+
+// Span over a scope or up to end(), recorded only for sampled ids
+class TraceSpan {
+public:
+    TraceSpan(const char* name, uint64_t trace_id);
+    ~TraceSpan() { end(); }
+    void end();
+
+private:
+    TraceSpan(const TraceSpan&);
+    TraceSpan& operator=(const TraceSpan&);
+
+    const char* name_;
+    uint64_t trace_id_;   // 0 = not sampled
+    int64_t start_ns_;
+};
+
+inline TraceSpan::TraceSpan(const char* name, uint64_t trace_id)
+    : name_(name), trace_id_(Trace::sampled(trace_id) ? trace_id : 0), start_ns_(trace_id_ ? Clock::monotonicNs() : 0) {}
+
+inline void TraceSpan::end() {
+    if (!trace_id_) return;
+    Trace::span(name_, trace_id_, start_ns_, Clock::monotonicNs());
+    trace_id_ = 0;
+}
@@ -1,17 +1,15 @@
 #include "transaction.h"
 #include "utils.h"
+#include "clock.h"
 #include <sstream>
 #include <iomanip>
 #include <random>
 
-Transaction::Transaction() : transaction_id(0), amount(0.0), merchant_id(0) {
-    timestamp = getCurrentTimestamp();
-}
+Transaction::Transaction() : transaction_id(0), amount(0.0), timestamp(getCurrentTimestamp()), merchant_id(0) {}
 
 Transaction::Transaction(long id, const std::string& card, double amt, int merchant, const std::string& loc)
-    : transaction_id(id), card_number(card), amount(amt), merchant_id(merchant), location(loc) {
-    timestamp = getCurrentTimestamp();
-}
+    : transaction_id(id), card_number(card), amount(amt), timestamp(getCurrentTimestamp()),
+      merchant_id(merchant), location(loc) {}
 
 std::string Transaction::serialize() const {
     std::ostringstream oss;
@@ -44,11 +42,7 @@ bool Transaction::isValid() const {
     return Utils::luhnCheck(card_number);
 }
 
-std::string Transaction::getCurrentTimestamp() {
-    auto now = std::time(nullptr);
-    auto tm = *std::localtime(&now);
-    
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%SZ");
-    return oss.str();
+const std::string& Transaction::getCurrentTimestamp() {
+    // Cached per second per thread; see Clock::isoTimestamp
+    return Clock::isoTimestamp();
 }
\ No newline at end of file
@@ -22,7 +22,9 @@ struct Transaction {
     
     // Validate transaction (Luhn algorithm for card, amount > 0)
     bool isValid() const;
-    
-    // Generate timestamp string
-    static std::string getCurrentTimestamp();
+
+private:
+    // Timestamp string (UTC, second resolution); the calling thread's cached copy, valid
+    // until its next call, so only the constructors use it and copy it straight away
+    static const std::string& getCurrentTimestamp();
 };
\ No newline at end of file
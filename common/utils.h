@@ -22,6 +22,9 @@ public:
     // Get random location from predefined list
     static std::string getRandomLocation();
     
+    // The predefined location list (for per-location aggregation)
+    static const std::vector<std::string>& getLocations() { return locations; }
+    
 private:
     static std::vector<std::string> locations;
 };
\ No newline at end of file
@@ -0,0 +1,102 @@
+#include "card_cache.h"
+#include <cmath>
+
+CardCache::CardCache(size_t capacity, double decay_seconds)
+    : size_(0), hand_(0), decay_ns_(decay_seconds * 1e9), latest_ns_(0), hits_(0), misses_(0), evictions_(0) {
+    size_t cap = 16;
+    while (cap < capacity) cap <<= 1;
+    slots_.assign(cap, Slot{});
+    mask_ = cap - 1;
+    max_size_ = cap - cap / 4;  // keep load factor <= 0.75 so probe chains stay short
+}
+
+uint64_t CardCache::packCard(const std::string& card_number) {
+    // Up to 19 digits fit in a uint64; a leading 1 keeps "0..." distinct and never 0
+    uint64_t key = 1;
+    for (char c : card_number) {
+        if (c >= '0' && c <= '9') key = key * 10 + (c - '0');
+    }
+    return key;
+}
+
+size_t CardCache::home(uint64_t key) const {
+    // Fibonacci hashing spreads sequential card numbers across the table
+    return (key * 0x9E3779B97F4A7C15ULL >> 17) & mask_;
+}
+
+CardFeatures CardCache::observe(const std::string& card_number, double amount, int64_t now_ns) {
+    if (now_ns > latest_ns_) latest_ns_ = now_ns;
+    uint64_t key = packCard(card_number);
+    size_t idx = home(key);
+    while (slots_[idx].key != 0 && slots_[idx].key != key) {
+        idx = (idx + 1) & mask_;
+    }
+
+    CardFeatures f;
+    if (slots_[idx].key == key) {
+        Slot& s = slots_[idx];
+        hits_++;
+        if (now_ns < s.last_ns) now_ns = s.last_ns;
+        double dt = static_cast<double>(now_ns - s.last_ns);
+        double decay = dt > 0 ? std::exp(-dt / decay_ns_) : 1.0;
+        f.seen_before = true;
+        f.seconds_since_last = dt / 1e9;
+        f.avg_amount = s.velocity > 0 ? s.amount_sum / s.velocity : 0.0;
+        s.velocity = static_cast<float>(s.velocity * decay + 1.0);
+        s.amount_sum = static_cast<float>(s.amount_sum * decay + amount);
+        s.last_ns = now_ns;
+        s.referenced = 1;
+        f.velocity = s.velocity;
+        return f;
+    }
+
+    misses_++;
+    if (size_ >= max_size_) {
+        evictOne();
+        // Eviction may shift entries; find the insertion slot again
+        idx = home(key);
+        while (slots_[idx].key != 0) idx = (idx + 1) & mask_;
+    }
+    Slot& s = slots_[idx];
+    s.key = key;
+    s.last_ns = now_ns;
+    s.velocity = 1.0f;
+    s.amount_sum = static_cast<float>(amount);
+    s.referenced = 1;
+    size_++;
+    f.velocity = 1.0;
+    return f;
+}
+
+void CardCache::evictOne() {
+    // CLOCK: clear reference bits until an unreferenced slot comes under the hand
+    while (true) {
+        Slot& s = slots_[hand_];
+        if (s.key != 0) {
+            if (!s.referenced) {
+                erase(hand_);
+                evictions_++;
+                return;
+            }
+            s.referenced = 0;
+        }
+        hand_ = (hand_ + 1) & mask_;
+    }
+}
+
+void CardCache::erase(size_t idx) {
+    // Backward-shift deletion keeps linear probe chains intact without tombstones
+    size_t hole = idx;
+    size_t next = (hole + 1) & mask_;
+    while (slots_[next].key != 0) {
+        size_t want = home(slots_[next].key);
+        // Move the entry back if the hole lies between its home slot and its current slot
+        if (((next - want) & mask_) >= ((next - hole) & mask_)) {
+            slots_[hole] = slots_[next];
+            hole = next;
+        }
+        next = (next + 1) & mask_;
+    }
+    slots_[hole] = Slot{};
+    size_--;
+}
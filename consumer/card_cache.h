@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Memory-bounded per-card feature cache for fraud scoring.
+// - Open addressing with linear probing over a flat power-of-two array
+// - 32-byte slots keyed by the card number packed into a uint64
+// - CLOCK (second-chance) eviction once the load limit is reached
+// - Exponentially time-decayed velocity and amount counters per card, clocked by the
+//   transactions' own times so a replayed history decays as it did when it happened
+
+struct CardFeatures {
+    bool seen_before = false;     // card was in the cache before this transaction
+    double velocity = 0.0;        // decayed transaction count, including this one
+    double avg_amount = 0.0;      // decayed average amount before this transaction
+    double seconds_since_last = 0.0;
+};
+
+class CardCache {
+public:
+    // capacity is rounded up to a power of two; decay_seconds is the counter time constant
+    explicit CardCache(size_t capacity = 1 << 16, double decay_seconds = 60.0);
+
+    // Record a transaction for the card and return its features. now_ns is the transaction's
+    // time; one older than the card's last transaction counts as simultaneous with it.
+    CardFeatures observe(const std::string& card_number, double amount, int64_t now_ns);
+
+    // Latest transaction time observed, for transactions without a usable time of their own
+    int64_t latestNs() const { return latest_ns_; }
+
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+    uint64_t evictions() const { return evictions_; }
+    double hitRate() const { return hits_ + misses_ ? hits_ * 1.0 / (hits_ + misses_) : 0.0; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return slots_.size(); }
+    size_t memoryBytes() const { return slots_.size() * sizeof(Slot); }
+
+private:
+    struct Slot {
+        uint64_t key;             // 0 = empty
+        int64_t last_ns;
+        float velocity;
+        float amount_sum;         // decayed sum of amounts; avg = amount_sum / velocity
+        uint32_t referenced;      // CLOCK bit
+        uint32_t pad;
+    };
+
+    static uint64_t packCard(const std::string& card_number);
+    size_t home(uint64_t key) const;
+    void evictOne();
+    void erase(size_t idx);
+
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_;
+    size_t max_size_;
+    size_t hand_;
+    double decay_ns_;
+    int64_t latest_ns_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+    uint64_t evictions_;
+};
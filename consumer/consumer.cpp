@@ -1,5 +1,13 @@
 #include "../common/transaction.h"
 #include "../common/utils.h"
+#include "../common/clock.h"
+#include "../common/shm_ring.h"
+#include "../common/cluster_map.h"
+#include "../common/low_latency.h"
+#include "../common/trace.h"
+#include "card_cache.h"
+#include "fraud_rules.h"
+#include "live_stats.h"
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -8,16 +16,30 @@
 #include <cstring>
 #include <thread>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <memory>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <unistd.h>
 
-// Simulate CPU-intensive fraud detection scoring
-static double compute_fraud_score(const Transaction& t) {
+// Rules and model weights (--rules FILE), swapped in place on hot reload
+static FraudRules fraud_rules;
+
+// Stages 1-2 of scoring: simulated lookup and decryption work, mixed into the final score
+static uint64_t simulate_lookup(const Transaction& t, uint64_t trace_id) {
     // 1. Simulate database lookup via hash computation
+    TraceSpan hash_span("score.hash", trace_id);
     std::string key = t.card_number + std::to_string(t.amount) + t.timestamp;
     uint64_t hash = 0;
     for (char c : key) {
@@ -29,97 +51,424 @@ static double compute_fraud_score(const Transaction& t) {
         hash = hash * 1103515245 + 12345;  // Linear congruential generator
         hash ^= (hash >> 16);               // Bit mixing
     }
+    return hash;
+}
+
+// Stage 4: simulate network delay for external API calls (e.g., credit bureau check)
+static void simulate_external_call(uint64_t trace_id) {
+    TraceSpan external_span("score.external", trace_id);
+    std::this_thread::sleep_for(std::chrono::microseconds(100)); // 0.1ms per transaction
+}
+
+// Simulate CPU-intensive fraud detection scoring; each stage is a span for sampled messages.
+// Stage 3, the rules and model, comes from the loaded rule plan.
+static double compute_fraud_score(const Transaction& t, const CardFeatures& card, const RulePlan& plan, uint64_t trace_id) {
+    uint64_t hash = simulate_lookup(t, trace_id);
     
-    // 3. Rule-based fraud scoring
-    double fraud_score = 0.0;
-    fraud_score += (t.amount > 10000) ? 0.3 : 0.0;      // Large transactions suspicious
-    fraud_score += (t.amount < 1) ? 0.2 : 0.0;          // Micro-transactions suspicious
-    fraud_score += (t.card_number.length() != 16) ? 0.5 : 0.0;  // Invalid format
+    // 3. Rule-based fraud scoring and ML model
+    TraceSpan rules_span("score.rules", trace_id);
+    double fraud_score = plan.score(RuleInput::from(t, card));
+    rules_span.end();
     
-    // Add complexity based on card digits (force CPU to work through string)
-    for (size_t i = 0; i < t.card_number.length(); i++) {
-        if (t.card_number[i] >= '0' && t.card_number[i] <= '9') {
-            fraud_score += (t.card_number[i] - '0') * 0.001;
-        }
-    }
+    simulate_external_call(trace_id);
     
-    // 4. Simulate ML model inference (simple matrix operations)
-    double features[10];
-    double weights[10] = {0.1, 0.2, 0.15, 0.3, 0.05, 0.1, 0.2, 0.15, 0.05, 0.1};
-    for (int i = 0; i < 10; i++) {
-        features[i] = (t.amount + i * 100) / 10000.0;
+    // Use hash in calculation to prevent optimization
+    return fraud_score + (hash % 100) * 0.0001;
+}
+
+// Parse a line and update its card's features; false (after reporting) if it does not parse
+static bool parse_transaction(const std::string& line, CardCache& cards, int lineNumber,
+                              Transaction& t, CardFeatures& features, uint64_t& trace_id) {
+    trace_id = Trace::enabled() ? Trace::idOf(line) : 0;
+    try {
+        TraceSpan parse_span("consumer.parse", trace_id);
+        t = Transaction::deserialize(line);
+        parse_span.end();
+    } catch (const std::exception& e) {
+        std::cerr << "Error parsing line " << lineNumber << ": " << e.what() << std::endl;
+        return false;
     }
-    double ml_score = 0;
-    for (int i = 0; i < 10; i++) {
-        ml_score += features[i] * weights[i];
+    // Card features run on the transaction's own clock, so a file or replay covering hours
+    // of history sees the same velocities as the live stream did
+    TraceSpan features_span("consumer.features", trace_id);
+    int64_t secs;
+    int64_t event_ns = Clock::parseIsoTimestamp(t.timestamp, secs) ? secs * 1000000000LL : cards.latestNs();
+    features = cards.observe(t.card_number, t.amount, event_ns);
+    return true;
+}
+
+static void record_result(const Transaction& t, double fraud_score, const RulePlan& plan, LiveStats::Shard& stats) {
+    bool passed_fraud_check = (fraud_score < plan.threshold());  // Threshold for fraud detection
+    stats.record(t, fraud_score, t.isValid() && passed_fraud_check);
+    if (stats.total.get() % 50000 == 0) {
+        std::cout << "  Processed " << stats.total.get() << " transactions..." << std::endl;
     }
-    fraud_score += ml_score * 0.1;
+}
+
+// Process a single transaction line and update stats; returns true if processed
+static bool process_line(const std::string& line, LiveStats::Shard& stats, CardCache& cards, int lineNumber) {
+    if (line.empty()) return false;
+    Transaction t;
+    CardFeatures features;
+    uint64_t trace_id;
+    if (!parse_transaction(line, cards, lineNumber, t, features, trace_id)) return false;
     
-    // 5. Simulate network delay for external API calls (e.g., credit bureau check)
-    std::this_thread::sleep_for(std::chrono::microseconds(100)); // 0.1ms per transaction
+    // Perform CPU-intensive fraud detection; a reload mid-transaction does not affect this plan
+    const RulePlan& plan = fraud_rules.plan();
+    double fraud_score = compute_fraud_score(t, features, plan, trace_id);
+    record_result(t, fraud_score, plan, stats);
+    return true;
+}
+
+// Summed over all caches (file mode keeps one per worker thread)
+static void print_card_cache(const std::vector<const CardCache*>& caches) {
+    uint64_t hits = 0, misses = 0, evictions = 0;
+    size_t size = 0, capacity = 0, bytes = 0;
+    for (const CardCache* c : caches) {
+        hits += c->hits(); misses += c->misses(); evictions += c->evictions();
+        size += c->size(); capacity += c->capacity(); bytes += c->memoryBytes();
+    }
+    std::cout << "\n=== Card Feature Cache ===" << std::endl;
+    if (caches.size() > 1) std::cout << "Caches: " << caches.size() << " (one per thread)" << std::endl;
+    std::cout << "Cards tracked: " << size << " / " << capacity
+              << " (" << bytes / 1024 << " KB)" << std::endl;
+    std::cout << "Hit rate: " << std::fixed << std::setprecision(2)
+              << (hits + misses ? hits * 100.0 / (hits + misses) : 0.0) << "% ("
+              << hits << " hits, " << misses << " misses, "
+              << evictions << " evictions)" << std::endl;
+}
+
+// One registry per process, so the HTTP thread can read it for the whole run
+static LiveStats live_stats;
+
+static void print_summary(const std::vector<const CardCache*>& caches) {
+    live_stats.print();
+    print_card_cache(caches);
+    live_stats.printInvalidSample();
+}
+
+struct Endpoint {
+    std::string host;
+    uint16_t port;
+};
+
+// Resolve and connect; returns the socket or -1
+static int connect_broker(const Endpoint& ep) {
+    int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) { perror("socket"); return -1; }
     
-    // Use hash in calculation to prevent optimization
-    fraud_score += (hash % 100) * 0.0001;
+    // Resolve hostname using getaddrinfo (supports both IP addresses and hostnames like "broker")
+    struct addrinfo hints{}, *result;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string port_str = std::to_string(ep.port);
+    
+    int rv = getaddrinfo(ep.host.c_str(), port_str.c_str(), &hints, &result);
+    if (rv != 0) {
+        std::cerr << "getaddrinfo failed: " << gai_strerror(rv) << std::endl;
+        close(sockfd);
+        return -1;
+    }
+    
+    if (connect(sockfd, result->ai_addr, result->ai_addrlen) < 0) {
+        perror("connect");
+        freeaddrinfo(result);
+        close(sockfd);
+        return -1;
+    }
     
-    return fraud_score;
+    freeaddrinfo(result);
+    return sockfd;
 }
 
-struct Statistics {
-    int total_transactions = 0;
-    int valid_transactions = 0;
-    int invalid_transactions = 0;
-    double total_amount = 0.0;
-    double valid_amount = 0.0;
-    
-    void print() const {
-        std::cout << "\n=== Transaction Statistics ===" << std::endl;
-        std::cout << "Total Transactions: " << total_transactions << std::endl;
-        std::cout << "Valid Transactions: " << valid_transactions 
-                  << " (" << (total_transactions > 0 ? (valid_transactions * 100.0 / total_transactions) : 0) 
-                  << "%)" << std::endl;
-        std::cout << "Invalid Transactions: " << invalid_transactions 
-                  << " (" << (total_transactions > 0 ? (invalid_transactions * 100.0 / total_transactions) : 0) 
-                  << "%)" << std::endl;
-        std::cout << "Total Amount: $" << std::fixed << std::setprecision(2) << total_amount << std::endl;
-        std::cout << "Valid Amount: $" << std::fixed << std::setprecision(2) << valid_amount << std::endl;
-        std::cout << "Average Transaction: $" << std::fixed << std::setprecision(2) 
-                  << (total_transactions > 0 ? total_amount / total_transactions : 0) << std::endl;
-        std::cout << "Average Valid Transaction: $" << std::fixed << std::setprecision(2) 
-                  << (valid_transactions > 0 ? valid_amount / valid_transactions : 0) << std::endl;
+// After losing the broker, cycle through the other endpoints (standbys) for a while
+static int reconnect_broker(const std::vector<Endpoint>& endpoints, size_t& current) {
+    for (int round = 0; round < 50; round++) {
+        for (size_t k = 1; k <= endpoints.size(); k++) {
+            size_t idx = (current + k) % endpoints.size();
+            int fd = connect_broker(endpoints[idx]);
+            if (fd >= 0) {
+                current = idx;
+                std::cout << "Reconnected to broker at " << endpoints[idx].host << ":" << endpoints[idx].port << std::endl;
+                return fd;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
+    return -1;
+}
+
+// Options accepted after the mode arguments in every mode
+struct ConsumerOptions {
+    std::string latency_path;             // --latency-out <file>
+    size_t card_cache_entries = 1 << 16;  // --card-cache <entries>
+    double card_decay_s = 60.0;           // --card-decay <seconds>
+    long spin = 1000;                     // --spin <iterations> before parking (shared-memory mode)
+    std::vector<Endpoint> failover;       // --failover <host:port>, repeatable (--connect mode)
+    uint16_t http_port = 0;               // --http-port <port>, 0 = no live statistics endpoint
+    unsigned threads = 0;                 // --threads <n>, file mode workers; 0 = one per core
+    int low_latency_cpu = -1;             // --low-latency <cpu>, client mode pinned to this core; -1 = off
+    int busy_poll_us = 50;                // --busy-poll-us <usec>, SO_BUSY_POLL budget in low-latency mode
+    uint64_t trace_sample = 0;            // --trace-sample <n>, trace 1 in n messages; 0 = off
+    std::string trace_path;               // --trace-out <file>, default consumer-<pid>.trace.json
+    std::string rules_path;               // --rules <file>, fraud rules and weights; empty = built-in
+    int rules_reload_ms = 1000;           // --rules-reload-ms <ms>, poll interval for rule changes; 0 = never
 };
 
-// Process a single transaction line and update stats; returns true if processed
-static bool process_line(const std::string& line, Statistics& stats, std::vector<Transaction>& invalidTransactions, int lineNumber) {
-    if (line.empty()) return false;
-    try {
-        Transaction t = Transaction::deserialize(line);
-        stats.total_transactions++;
-        stats.total_amount += t.amount;
-        
-        // Perform CPU-intensive fraud detection
-        double fraud_score = compute_fraud_score(t);
-        bool passed_fraud_check = (fraud_score < 0.8);  // Threshold for fraud detection
-        
-        if (t.isValid() && passed_fraud_check) {
-            stats.valid_transactions++;
-            stats.valid_amount += t.amount;
+static bool parse_options(int argc, char* argv[], int first, ConsumerOptions& opts) {
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) { std::cerr << "Missing value for " << arg << std::endl; return false; }
+        std::string val = argv[++i];
+        if (arg == "--latency-out") opts.latency_path = val;
+        else if (arg == "--card-cache") opts.card_cache_entries = std::stoul(val);
+        else if (arg == "--card-decay") opts.card_decay_s = std::stod(val);
+        else if (arg == "--spin") opts.spin = std::stol(val);
+        else if (arg == "--http-port") opts.http_port = static_cast<uint16_t>(std::stoi(val));
+        else if (arg == "--threads") opts.threads = static_cast<unsigned>(std::stoul(val));
+        else if (arg == "--low-latency") opts.low_latency_cpu = std::stoi(val);
+        else if (arg == "--busy-poll-us") opts.busy_poll_us = std::stoi(val);
+        else if (arg == "--trace-sample") opts.trace_sample = std::stoull(val);
+        else if (arg == "--trace-out") opts.trace_path = val;
+        else if (arg == "--rules") opts.rules_path = val;
+        else if (arg == "--rules-reload-ms") opts.rules_reload_ms = std::stoi(val);
+        else if (arg == "--failover") {
+            size_t colon = val.rfind(':');
+            if (colon == std::string::npos) { std::cerr << "--failover expects HOST:PORT" << std::endl; return false; }
+            opts.failover.push_back({val.substr(0, colon), static_cast<uint16_t>(std::stoi(val.substr(colon + 1)))});
+        }
+        else { std::cerr << "Unknown option " << arg << std::endl; return false; }
+    }
+    return true;
+}
+
+// Optional per-message completion log used by the loadtest harness.
+// Each record is "<transaction_id> <Clock::monotonicNs()>" written after the ACK is sent;
+// the producer side pairs it with its own send time to get end-to-end latency.
+// Records are flushed in small batches so a killed consumer loses only the tail.
+class LatencyRecorder {
+public:
+    bool open(const std::string& path) {
+        file_ = std::fopen(path.c_str(), "w");
+        return file_ != nullptr;
+    }
+
+    void record(const std::string& line) {
+        if (!file_) return;
+        long id = std::strtol(line.c_str(), nullptr, 10);
+        std::fprintf(file_, "%ld %lld\n", id, (long long)Clock::monotonicNs());
+        if (++unflushed_ >= FLUSH_EVERY) {
+            std::fflush(file_);
+            unflushed_ = 0;
+        }
+    }
+
+    void close() {
+        if (file_) { std::fclose(file_); file_ = nullptr; }
+    }
+
+    ~LatencyRecorder() { close(); }
+
+private:
+    static const int FLUSH_EVERY = 256;
+    std::FILE* file_ = nullptr;
+    int unflushed_ = 0;
+};
+
+static const size_t RECV_BLOCK_BYTES = 256 * 1024;   // per connection, far more than a window of records
+static const int RECV_MARKS = 64;
+
+// Stream position just past one read, and when it arrived
+struct RecvMark {
+    uint64_t end;
+    int64_t ns;
+};
+
+// One broker connection of a client-mode consumer
+struct BrokerConn {
+    std::string name;
+    std::vector<Endpoint> endpoints;   // primary first, then standbys
+    size_t current = 0;
+    int fd = -1;
+    char* buf = nullptr;               // fixed receive block; bytes [head, tail) are not processed yet
+    size_t head = 0;
+    size_t tail = 0;
+    uint64_t received = 0;             // stream bytes received on this connection
+    RecvMark marks[RECV_MARKS];        // ring of reads not fully processed, oldest first
+    int mark_first = 0;
+    int mark_count = 0;
+
+    void reset() {
+        head = tail = 0;
+        received = 0;
+        mark_first = mark_count = 0;
+    }
+
+    void markRead(size_t n, int64_t ns) {
+        received += n;
+        if (mark_count == RECV_MARKS) {
+            // Ring full: fold into the newest read, which makes these bytes look older, never newer
+            marks[(mark_first + mark_count - 1) % RECV_MARKS].end = received;
+            return;
+        }
+        marks[(mark_first + mark_count) % RECV_MARKS] = {received, ns};
+        mark_count++;
+    }
+
+    // Arrival time of the read that completed the bytes up to stream position end.
+    // Lines are processed in order, so reads that end before it are done with.
+    int64_t arrivalNs(uint64_t end) {
+        while (mark_count > 1 && marks[mark_first].end < end) {
+            mark_first = (mark_first + 1) % RECV_MARKS;
+            mark_count--;
+        }
+        return mark_count ? marks[mark_first].ns : Clock::monotonicNs();
+    }
+};
+
+static const int FAIR_QUANTUM = 64;   // lines taken from one broker before moving to the next
+
+// Client mode: consume pushed records from one or more brokers (shards).
+// Each round takes at most FAIR_QUANTUM lines from every broker in turn, so a broker
+// with a deep backlog cannot starve the others. ACKs are positional per broker, so each
+// one goes back on the connection its line came from.
+// Lines are parsed in place in each connection's receive block; the summary reports the
+// receive-to-ACK latency. In low-latency mode the thread is pinned, the blocks come from
+// a pre-faulted pool and the loop spins on non-blocking reads instead of poll().
+static int run_client(std::vector<BrokerConn>& conns, const ConsumerOptions& opts) {
+    bool low_latency = opts.low_latency_cpu >= 0;
+    bool busy_poll_warned = false;
+    auto tune_socket = [&](int fd) {
+        if (fd < 0 || !low_latency || LowLatency::busyPoll(fd, opts.busy_poll_us) || busy_poll_warned) return;
+        std::cerr << "Warning: SO_BUSY_POLL refused (needs CAP_NET_ADMIN above net.core.busy_read), "
+                  << "spinning on non-blocking reads only" << std::endl;
+        busy_poll_warned = true;
+    };
+    for (BrokerConn& c : conns) {
+        c.fd = connect_broker(c.endpoints[0]);
+        if (c.fd < 0) return 1;
+        tune_socket(c.fd);
+        std::cout << "Connected to " << c.name << " at " << c.endpoints[0].host << ":" << c.endpoints[0].port << std::endl;
+    }
+
+    BufferPool pool;
+    std::vector<std::vector<char>> heap_blocks;
+    if (low_latency) {
+        std::string err;
+        if (!LowLatency::pinThread(opts.low_latency_cpu, err)) {
+            std::cerr << "Cannot pin to cpu " << opts.low_latency_cpu << ": " << err << std::endl;
+            return 1;
+        }
+        if (!pool.init(RECV_BLOCK_BYTES, conns.size())) { perror("mmap"); return 1; }
+        for (BrokerConn& c : conns) c.buf = pool.acquire();
+        std::cout << "Low-latency mode: pinned to cpu " << opts.low_latency_cpu << ", busy-polling ("
+                  << opts.busy_poll_us << " us), " << (pool.hugePages() ? "huge-page" : "pre-faulted")
+                  << " receive buffers" << std::endl;
+    } else {
+        heap_blocks.assign(conns.size(), std::vector<char>(RECV_BLOCK_BYTES));
+        for (size_t i = 0; i < conns.size(); i++) conns[i].buf = heap_blocks[i].data();
+    }
+
+    LatencyRecorder latency;
+    if (!opts.latency_path.empty() && !latency.open(opts.latency_path)) {
+        std::cerr << "Warning: Could not open " << opts.latency_path << " for latency records" << std::endl;
+    }
+
+    CardCache cards(opts.card_cache_entries, opts.card_decay_s);
+    LiveStats::Shard& stats = live_stats.addShard();
+    LatencyHistogram turnaround;
+    std::vector<pollfd> fds;
+    std::vector<size_t> fd_conn;
+    std::string line;   // reused, so the steady state does not allocate per record
+    int lineNumber = 0;
+    size_t live = conns.size();
+    size_t round = 0;
+    bool ready = false;   // some broker still has complete lines buffered
+
+    auto read_conn = [&](BrokerConn& c, int flags) {
+        if (RECV_BLOCK_BYTES - c.tail < RECV_BLOCK_BYTES / 2 && c.head > 0) {
+            std::memmove(c.buf, c.buf + c.head, c.tail - c.head);
+            c.tail -= c.head;
+            c.head = 0;
+        }
+        if (c.tail == RECV_BLOCK_BYTES) {
+            // One record filled the block: drop its head, the rest still ends in one ERR
+            std::cerr << "Dropping oversized record from " << c.name << std::endl;
+            c.head = c.tail = 0;
+        }
+        ssize_t n = recv(c.fd, c.buf + c.tail, RECV_BLOCK_BYTES - c.tail, flags);
+        if (n < 0 && (flags & MSG_DONTWAIT) && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n < 0) { perror("recv"); }
+        if (n <= 0) {
+            // Broker gone: with standbys configured, follow the failover and keep going.
+            // Unacked messages are redelivered by the new broker, partial input is dropped.
+            close(c.fd);
+            c.fd = c.endpoints.size() > 1 ? reconnect_broker(c.endpoints, c.current) : -1;
+            tune_socket(c.fd);
+            c.reset();
+            if (c.fd < 0) live--;
+            return;
+        }
+        c.tail += static_cast<size_t>(n);
+        c.markRead(static_cast<size_t>(n), Clock::monotonicNs());
+    };
+
+    while (live > 0) {
+        if (low_latency) {
+            for (BrokerConn& c : conns) {
+                if (c.fd >= 0) read_conn(c, MSG_DONTWAIT);
+            }
         } else {
-            stats.invalid_transactions++;
-            invalidTransactions.push_back(t);
+            fds.clear();
+            fd_conn.clear();
+            for (size_t i = 0; i < conns.size(); i++) {
+                if (conns[i].fd < 0) continue;
+                fds.push_back({conns[i].fd, POLLIN, 0});
+                fd_conn.push_back(i);
+            }
+            if (poll(fds.data(), fds.size(), ready ? 0 : -1) < 0 && errno != EINTR) { perror("poll"); break; }
+            for (size_t k = 0; k < fds.size(); k++) {
+                if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) read_conn(conns[fd_conn[k]], 0);
+            }
         }
-        if (stats.total_transactions % 50000 == 0) {
-            std::cout << "  Processed " << stats.total_transactions << " transactions..." << std::endl;
+
+        ready = false;
+        for (size_t k = 0; k < conns.size(); k++) {
+            BrokerConn& c = conns[(round + k) % conns.size()];
+            if (c.fd < 0) continue;
+            for (int taken = 0; taken < FAIR_QUANTUM; taken++) {
+                char* start = c.buf + c.head;
+                char* nl = static_cast<char*>(std::memchr(start, '\n', c.tail - c.head));
+                if (!nl) break;
+                line.assign(start, nl);
+                c.head = static_cast<size_t>(nl - c.buf) + 1;
+                int64_t arrived = c.arrivalNs(c.received - (c.tail - c.head));
+                uint64_t trace_id = Trace::enabled() ? Trace::idOf(line) : 0;
+                if (Trace::sampled(trace_id)) Trace::span("consumer.wait", trace_id, arrived, Clock::monotonicNs());
+                lineNumber++;
+                bool ok = process_line(line, stats, cards, lineNumber);
+                const char* ack = ok ? "ACK\n" : "ERR\n";
+                TraceSpan ack_span("consumer.ack", trace_id);
+                send(c.fd, ack, strlen(ack), MSG_NOSIGNAL);
+                ack_span.end();
+                latency.record(line);
+                turnaround.record(Clock::monotonicNs() - arrived);
+            }
+            if (c.head == c.tail) c.head = c.tail = 0;
+            else if (std::memchr(c.buf + c.head, '\n', c.tail - c.head)) ready = true;
         }
-        return true;
-    } catch (const std::exception& e) {
-        std::cerr << "Error parsing line " << lineNumber << ": " << e.what() << std::endl;
-        return false;
+        round++;
     }
+    latency.close();
+    print_summary({&cards});
+    std::cout << "\n=== Receive-to-ACK Latency (" << (low_latency ? "low-latency" : "default") << " mode) ===" << std::endl;
+    std::cout << turnaround.summary() << std::endl;
+    std::cout << "\nConsumer client completed successfully!" << std::endl;
+    return 0;
 }
 
 // Run as TCP server on given port, read newline-delimited records, send "ACK\n"
-static int run_server(uint16_t port) {
+static int run_server(uint16_t port, const ConsumerOptions& opts) {
     int server_fd = ::socket(AF_INET, SOCK_STREAM, 0);
     if (server_fd < 0) { perror("socket"); return 1; }
     int opt = 1;
@@ -132,8 +481,8 @@ static int run_server(uint16_t port) {
     if (listen(server_fd, 5) < 0) { perror("listen"); close(server_fd); return 1; }
     std::cout << "Listening on 0.0.0.0:" << port << " ..." << std::endl;
 
-    Statistics stats;
-    std::vector<Transaction> invalids;
+    LiveStats::Shard& stats = live_stats.addShard();
+    CardCache cards(opts.card_cache_entries, opts.card_decay_s);
     int client_fd;
     sockaddr_in cli{}; socklen_t clilen = sizeof(cli);
     client_fd = accept(server_fd, (sockaddr*)&cli, &clilen);
@@ -154,7 +503,7 @@ static int run_server(uint16_t port) {
             std::string line = buffer.substr(0, pos);
             buffer.erase(0, pos + 1);
             lineNumber++;
-            bool ok = process_line(line, stats, invalids, lineNumber);
+            bool ok = process_line(line, stats, cards, lineNumber);
             // Send ACK for each received line regardless of valid/invalid
             const char* ack = ok ? "ACK\n" : "ERR\n";
             send(client_fd, ack, strlen(ack), 0);
@@ -165,153 +514,291 @@ static int run_server(uint16_t port) {
     close(server_fd);
 
     // Print statistics
-    stats.print();
-    if (!invalids.empty()) {
-        std::cout << "\n=== Sample Invalid Transactions ===" << std::endl;
-        int samplesToShow = std::min(5, (int)invalids.size());
-        for (int i = 0; i < samplesToShow; i++) {
-            const auto& t = invalids[i];
-            std::cout << "ID: " << t.transaction_id 
-                      << ", Card: " << t.card_number
-                      << ", Amount: $" << t.amount;
-            if (t.amount <= 0) {
-                std::cout << " [Invalid: Amount <= 0]";
-            } else if (!Utils::luhnCheck(t.card_number)) {
-                std::cout << " [Invalid: Failed Luhn check]";
-            }
-            std::cout << std::endl;
-        }
-        if ((int)invalids.size() > samplesToShow) {
-            std::cout << "... and " << (invalids.size() - samplesToShow) << " more invalid transactions" << std::endl;
-        }
-    }
+    print_summary({&cards});
     std::cout << "\nConsumer server completed successfully!" << std::endl;
     return 0;
 }
 
-int main(int argc, char* argv[]) {
-    std::cout << "=== Fault-Tolerant Distributed Consumer ===" << std::endl;
+static inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
 
-    // Socket server mode: --server <port>
-    if (argc >= 3 && std::string(argv[1]) == "--server") {
-        uint16_t port = static_cast<uint16_t>(std::stoi(argv[2]));
-        return run_server(port);
+// Shared-memory client: attach to the broker's ring pair via its unix socket.
+// Messages arrive on one ring and ACK/ERR go back on the other; the unix socket
+// only carries the handshake and tells the broker when we die.
+static int run_shm_client(const std::string& path, const ConsumerOptions& opts) {
+    int sockfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) { perror("socket"); return 1; }
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    if (connect(sockfd, (sockaddr*)&addr, sizeof(addr)) < 0) { perror("connect"); close(sockfd); return 1; }
+
+    ShmChannel ch;
+    if (!ch.receiveFrom(sockfd)) {
+        std::cerr << "Shared-memory handshake with broker failed" << std::endl;
+        ch.close(); close(sockfd);
+        return 1;
     }
+    std::cout << "Attached to broker rings via " << path << std::endl;
 
-    // Socket client mode: --connect <host> <port>
-    if (argc >= 4 && std::string(argv[1]) == "--connect") {
-        std::string host = argv[2];
-        uint16_t port = static_cast<uint16_t>(std::stoi(argv[3]));
-        
-        // Connect to broker consumer port and process pushed records
-        int sockfd = ::socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) { perror("socket"); return 1; }
-        
-        // Resolve hostname using getaddrinfo (supports both IP addresses and hostnames like "broker")
-        struct addrinfo hints{}, *result;
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        std::string port_str = std::to_string(port);
-        
-        int rv = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result);
-        if (rv != 0) {
-            std::cerr << "getaddrinfo failed: " << gai_strerror(rv) << std::endl;
-            close(sockfd);
-            return 1;
+    LatencyRecorder latency;
+    if (!opts.latency_path.empty() && !latency.open(opts.latency_path)) {
+        std::cerr << "Warning: Could not open " << opts.latency_path << " for latency records" << std::endl;
+    }
+    CardCache cards(opts.card_cache_entries, opts.card_decay_s);
+    LiveStats::Shard& stats = live_stats.addShard();
+    std::string line;
+    int lineNumber = 0;
+    int unsignalled_acks = 0;
+    long spins = 0;
+    while (true) {
+        if (ch.to_consumer.tryRead(line)) {
+            lineNumber++;
+            bool ok = process_line(line, stats, cards, lineNumber);
+            const char* ack = ok ? "ACK" : "ERR";
+            // The broker never has more than a window of messages out, so the ACK ring cannot stay full
+            while (!ch.to_broker.tryWrite(ack, 3)) cpu_relax();
+            // Batch wakeups: the broker only needs one per burst of ACKs
+            if (++unsignalled_acks >= 32) { ch.to_broker.notify(); unsignalled_acks = 0; }
+            latency.record(line);
+            spins = 0;
+            continue;
         }
-        
-        if (connect(sockfd, result->ai_addr, result->ai_addrlen) < 0) {
-            perror("connect");
-            freeaddrinfo(result);
-            close(sockfd);
-            return 1;
+        if (unsignalled_acks > 0) { ch.to_broker.notify(); unsignalled_acks = 0; }
+        if (spins++ < opts.spin) { cpu_relax(); continue; }
+
+        // Ring stayed empty for the whole spin budget: park on the eventfd
+        if (!ch.to_consumer.prepareWait()) continue;
+        pollfd fds[2] = {{ch.to_consumer.eventfd(), POLLIN, 0}, {sockfd, POLLIN, 0}};
+        int rv = poll(fds, 2, -1);
+        ch.to_consumer.finishWait();
+        if (rv < 0 && errno != EINTR) { perror("poll"); break; }
+        if (rv > 0 && (fds[0].revents & POLLIN)) ch.to_consumer.drainWakeups();
+        if (rv > 0 && (fds[1].revents & (POLLIN | POLLHUP))) {
+            char b;
+            if (recv(sockfd, &b, 1, 0) <= 0) break;  // broker went away
         }
-        
-        freeaddrinfo(result);
-        std::cout << "Connected to broker at " << host << ":" << port << std::endl;
-
-        Statistics stats; std::vector<Transaction> invalids; std::string buffer; buffer.reserve(8192);
-        char buf[1024]; int lineNumber = 0;
-        while (true) {
-            ssize_t n = recv(sockfd, buf, sizeof(buf), 0);
-            if (n < 0) { perror("recv"); break; }
-            if (n == 0) { break; }
-            buffer.append(buf, buf + n);
-            size_t pos;
-            while ((pos = buffer.find('\n')) != std::string::npos) {
-                std::string line = buffer.substr(0, pos);
-                buffer.erase(0, pos + 1);
-                lineNumber++;
-                bool ok = process_line(line, stats, invalids, lineNumber);
-                const char* ack = ok ? "ACK\n" : "ERR\n";
-                send(sockfd, ack, strlen(ack), 0);
-            }
+        spins = 0;
+    }
+    ch.close();
+    close(sockfd);
+    latency.close();
+    print_summary({&cards});
+    std::cout << "\nConsumer shm client completed successfully!" << std::endl;
+    return 0;
+}
+
+// File mode: mmap the input, cut it into newline-aligned chunks and let a pool of
+// workers pull chunks off a shared counter. Each worker has its own stats shard and
+// card cache, so workers share nothing but the chunk counter.
+static int run_file(const std::string& path, const ConsumerOptions& opts) {
+    std::cout << "Reading transactions from: " << path << std::endl;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Error: Could not open file " << path << std::endl;
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) { perror("fstat"); close(fd); return 1; }
+    size_t size = static_cast<size_t>(st.st_size);
+    const char* data = nullptr;
+    if (size > 0) {
+        void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) { perror("mmap"); close(fd); return 1; }
+        // Each chunk is read front to back once
+        madvise(m, size, MADV_SEQUENTIAL);
+        madvise(m, size, MADV_WILLNEED);
+        data = static_cast<const char*>(m);
+    }
+    close(fd);
+
+    // Chunk boundaries sit just past a newline; many more chunks than threads keeps the pool balanced
+    const size_t CHUNK_BYTES = 1 << 20;
+    struct Chunk { size_t begin, end; int first_line; };
+    std::vector<Chunk> chunks;
+    int lines_before = 0;
+    for (size_t begin = 0; begin < size;) {
+        size_t end = std::min(size, begin + CHUNK_BYTES);
+        if (end < size) {
+            const void* nl = std::memchr(data + end, '\n', size - end);
+            end = nl ? static_cast<const char*>(nl) - data + 1 : size;
         }
-        close(sockfd);
-        stats.print();
-        if (!invalids.empty()) {
-            std::cout << "\n=== Sample Invalid Transactions ===" << std::endl;
-            int samplesToShow = std::min(5, (int)invalids.size());
-            for (int i = 0; i < samplesToShow; i++) {
-                const auto& t = invalids[i];
-                std::cout << "ID: " << t.transaction_id 
-                          << ", Card: " << t.card_number
-                          << ", Amount: $" << t.amount;
-                if (t.amount <= 0) {
-                    std::cout << " [Invalid: Amount <= 0]";
-                } else if (!Utils::luhnCheck(t.card_number)) {
-                    std::cout << " [Invalid: Failed Luhn check]";
+        chunks.push_back({begin, end, lines_before + 1});
+        lines_before += static_cast<int>(std::count(data + begin, data + end, '\n'));
+        begin = end;
+    }
+
+    unsigned threads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::max(1u, std::min<unsigned>(threads, std::max<size_t>(chunks.size(), 1)));
+    // Every worker needs a stats shard of its own: shards assume a single writer
+    if (threads > static_cast<unsigned>(LiveStats::MAX_SHARDS)) {
+        std::cout << "Limiting file mode to " << LiveStats::MAX_SHARDS << " threads (one statistics shard each)" << std::endl;
+        threads = LiveStats::MAX_SHARDS;
+    }
+    std::vector<LiveStats::Shard*> shards;
+    std::vector<std::unique_ptr<CardCache>> caches;
+    for (unsigned t = 0; t < threads; t++) {
+        shards.push_back(&live_stats.addShard());
+        caches.emplace_back(new CardCache(opts.card_cache_entries, opts.card_decay_s));
+    }
+
+    std::cout << "\nProcessing transactions (" << chunks.size() << " chunks, " << threads << " threads)..." << std::endl;
+    std::atomic<size_t> next_chunk(0);
+    int64_t start = Clock::monotonicNs();
+    // Lines are parsed in batches of RuleBatch::CAPACITY and the rules run column-wise over
+    // each batch; the per-transaction stages of scoring follow
+    auto worker = [&](unsigned t) {
+        std::string line;
+        RuleBatch batch;
+        std::vector<Transaction> txs(RuleBatch::CAPACITY);
+        uint64_t trace_ids[RuleBatch::CAPACITY];
+        double scores[RuleBatch::CAPACITY];
+        auto score_batch = [&]() {
+            const RulePlan& plan = fraud_rules.plan();
+            int64_t rules_start = Trace::enabled() ? Clock::monotonicNs() : 0;
+            plan.scoreBatch(batch, scores);
+            if (Trace::enabled()) {
+                int64_t rules_end = Clock::monotonicNs();
+                for (size_t k = 0; k < batch.size; k++) {
+                    if (Trace::sampled(trace_ids[k])) Trace::span("score.rules", trace_ids[k], rules_start, rules_end);
                 }
-                std::cout << std::endl;
+            }
+            for (size_t k = 0; k < batch.size; k++) {
+                uint64_t hash = simulate_lookup(txs[k], trace_ids[k]);
+                simulate_external_call(trace_ids[k]);
+                record_result(txs[k], scores[k] + (hash % 100) * 0.0001, plan, *shards[t]);
+            }
+            batch.size = 0;
+        };
+        for (size_t c; (c = next_chunk.fetch_add(1, std::memory_order_relaxed)) < chunks.size();) {
+            const char* p = data + chunks[c].begin;
+            const char* end = data + chunks[c].end;
+            int lineNumber = chunks[c].first_line;
+            while (p < end) {
+                const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+                const char* stop = nl ? nl : end;
+                line.assign(p, stop);
+                CardFeatures features;
+                size_t k = batch.size;
+                if (!line.empty() && parse_transaction(line, *caches[t], lineNumber, txs[k], features, trace_ids[k])) {
+                    batch.add(txs[k], features);
+                    if (batch.size == RuleBatch::CAPACITY) score_batch();
+                }
+                lineNumber++;
+                p = stop + 1;
             }
         }
-        std::cout << "\nConsumer client completed successfully!" << std::endl;
-        return 0;
+        if (batch.size) score_batch();
+    };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; t++) pool.emplace_back(worker, t);
+    worker(0);
+    for (auto& th : pool) th.join();
+    double secs = (Clock::monotonicNs() - start) / 1e9;
+    if (data) munmap(const_cast<char*>(data), size);
+
+    uint64_t rows = 0;
+    for (const LiveStats::Shard* sh : shards) rows += sh->total.get();
+    std::cout << "Processed " << rows << " rows in " << std::fixed << std::setprecision(2) << secs << " s ("
+              << std::setprecision(0) << (secs > 0 ? rows / secs : 0.0) << " rows/s, " << threads << " threads)" << std::endl;
+
+    std::vector<const CardCache*> cache_ptrs;
+    for (const auto& c : caches) cache_ptrs.push_back(c.get());
+    print_summary(cache_ptrs);
+    std::cout << "\nConsumer completed successfully!" << std::endl;
+    return 0;
+}
+
+// Compile the fraud rules and watch the file for changes; false if they do not compile
+static bool start_rules(const ConsumerOptions& opts) {
+    std::string error;
+    if (!fraud_rules.load(opts.rules_path, error)) {
+        std::cerr << "Error: " << error << std::endl;
+        return false;
     }
+    std::cout << "Fraud rules: " << fraud_rules.plan().ruleCount() << " rules from "
+              << (opts.rules_path.empty() ? "built-in defaults" : opts.rules_path) << std::endl;
+    fraud_rules.watch(opts.rules_reload_ms);
+    return true;
+}
 
-    // Default: file mode
-    std::string inputFile = "transactions.txt";
-    if (argc > 1) { inputFile = argv[1]; }
-    std::cout << "Reading transactions from: " << inputFile << std::endl;
+// Sampled tracing; the file is written when the consumer exits
+static void start_tracing(const ConsumerOptions& opts) {
+    if (!opts.trace_sample) return;
+    std::string path = opts.trace_path.empty() ? "consumer-" + std::to_string(getpid()) + ".trace.json" : opts.trace_path;
+    Trace::configure(opts.trace_sample, "consumer " + std::to_string(getpid()), Trace::LAST, path);
+    std::cout << "Tracing 1 in " << opts.trace_sample << " messages to " << path << std::endl;
+}
 
-    std::ifstream inFile(inputFile);
-    if (!inFile.is_open()) {
-        std::cerr << "Error: Could not open file " << inputFile << std::endl;
-        return 1;
+int main(int argc, char* argv[]) {
+    std::cout << "=== Fault-Tolerant Distributed Consumer ===" << std::endl;
+
+    ConsumerOptions opts;
+
+    // Socket server mode: --server <port> [options]
+    if (argc >= 3 && std::string(argv[1]) == "--server") {
+        uint16_t port = static_cast<uint16_t>(std::stoi(argv[2]));
+        if (!parse_options(argc, argv, 3, opts)) return 1;
+        if (!start_rules(opts)) return 1;
+        if (opts.http_port) start_stats_server(opts.http_port, live_stats);
+        start_tracing(opts);
+        return run_server(port, opts);
     }
 
-    Statistics stats;
-    std::vector<Transaction> invalidTransactions;
-    std::string line;
-    int lineNumber = 0;
-    std::cout << "\nProcessing transactions..." << std::endl;
-    while (std::getline(inFile, line)) {
-        lineNumber++;
-        process_line(line, stats, invalidTransactions, lineNumber);
-    }
-    inFile.close();
-
-    stats.print();
-    if (!invalidTransactions.empty()) {
-        std::cout << "\n=== Sample Invalid Transactions ===" << std::endl;
-        int samplesToShow = std::min(5, (int)invalidTransactions.size());
-        for (int i = 0; i < samplesToShow; i++) {
-            const auto& t = invalidTransactions[i];
-            std::cout << "ID: " << t.transaction_id 
-                      << ", Card: " << t.card_number
-                      << ", Amount: $" << t.amount;
-            if (t.amount <= 0) {
-                std::cout << " [Invalid: Amount <= 0]";
-            } else if (!Utils::luhnCheck(t.card_number)) {
-                std::cout << " [Invalid: Failed Luhn check]";
-            }
-            std::cout << std::endl;
-        }
-        if (invalidTransactions.size() > samplesToShow) {
-            std::cout << "... and " << (invalidTransactions.size() - samplesToShow) 
-                      << " more invalid transactions" << std::endl;
+    // Shared-memory mode: --shm <broker unix socket> [options]
+    if (argc >= 3 && std::string(argv[1]) == "--shm") {
+        if (!parse_options(argc, argv, 3, opts)) return 1;
+        if (!start_rules(opts)) return 1;
+        if (opts.http_port) start_stats_server(opts.http_port, live_stats);
+        start_tracing(opts);
+        return run_shm_client(argv[2], opts);
+    }
+
+    // Socket client mode: --connect <host> <port> [options]
+    if (argc >= 4 && std::string(argv[1]) == "--connect") {
+        std::string host = argv[2];
+        uint16_t port = static_cast<uint16_t>(std::stoi(argv[3]));
+        if (!parse_options(argc, argv, 4, opts)) return 1;
+        if (!start_rules(opts)) return 1;
+        if (opts.http_port) start_stats_server(opts.http_port, live_stats);
+        start_tracing(opts);
+        std::vector<BrokerConn> conns(1);
+        conns[0].name = "broker";
+        conns[0].endpoints = opts.failover;
+        conns[0].endpoints.insert(conns[0].endpoints.begin(), Endpoint{host, port});
+        return run_client(conns, opts);
+    }
+
+    // Sharded client mode: --cluster <map file or list> [options]; one connection per shard
+    if (argc >= 3 && std::string(argv[1]) == "--cluster") {
+        ClusterMap cluster;
+        std::string error;
+        if (!cluster.load(argv[2], error)) { std::cerr << error << std::endl; return 1; }
+        if (!parse_options(argc, argv, 3, opts)) return 1;
+        if (!opts.failover.empty()) { std::cerr << "--failover: list standbys in the cluster map instead" << std::endl; return 1; }
+        if (!start_rules(opts)) return 1;
+        if (opts.http_port) start_stats_server(opts.http_port, live_stats);
+        start_tracing(opts);
+        std::vector<BrokerConn> conns(cluster.size());
+        for (size_t i = 0; i < cluster.size(); i++) {
+            conns[i].name = cluster.shard(i).name;
+            for (const BrokerAddr& b : cluster.shard(i).brokers) conns[i].endpoints.push_back({b.host, b.consumer_port});
         }
+        return run_client(conns, opts);
     }
-    std::cout << "\nConsumer completed successfully!" << std::endl;
-    return 0;
-}
\ No newline at end of file
+
+    // Default: file mode [file] [options]
+    std::string inputFile = "transactions.txt";
+    int first_opt = 1;
+    if (argc > 1 && std::string(argv[1]).compare(0, 2, "--") != 0) { inputFile = argv[1]; first_opt = 2; }
+    if (!parse_options(argc, argv, first_opt, opts)) return 1;
+    if (!start_rules(opts)) return 1;
+    if (opts.http_port) start_stats_server(opts.http_port, live_stats);
+    start_tracing(opts);
+    return run_file(inputFile, opts);
+}
@@ -0,0 +1,253 @@
+#include "fraud_rules.h"
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+
+static const char* FEATURE_NAMES[RuleInput::NUM_FEATURES] = {
+    "amount", "card_length", "velocity", "avg_amount", "amount_ratio", "seen_before",
+    "seconds_since_last", "merchant", "digit_sum"
+};
+
+static const char* OP_NAMES[RulePlan::NUM_OPS] = {">", ">=", "<", "<=", "==", "!="};
+
+const char* RulePlan::DEFAULTS =
+    "rule amount > 10000 0.3\n"          // large transactions
+    "rule amount < 1 0.2\n"              // micro-transactions
+    "rule card_length != 16 0.5\n"       // invalid format
+    "rule velocity > 5 0.3\n"            // burst of activity on one card
+    "rule amount_ratio > 5 0.2\n"        // spike vs card history
+    "digit_weight 0.001\n"
+    "ml_weights 0.1 0.2 0.15 0.3 0.05 0.1 0.2 0.15 0.05 0.1\n"
+    "ml_step 100\n"
+    "ml_scale 10000\n"
+    "ml_factor 0.1\n"
+    "threshold 0.8\n";
+
+// Features of one transaction, written stride doubles apart (1 for a RuleInput, a column
+// step for a RuleBatch)
+static void extract_features(const Transaction& t, const CardFeatures& card, double* f, size_t stride) {
+    int digits = 0;
+    for (char c : t.card_number) {
+        if (c >= '0' && c <= '9') digits += c - '0';
+    }
+    f[RuleInput::AMOUNT * stride] = t.amount;
+    f[RuleInput::CARD_LENGTH * stride] = static_cast<double>(t.card_number.size());
+    f[RuleInput::VELOCITY * stride] = card.velocity;
+    f[RuleInput::AVG_AMOUNT * stride] = card.avg_amount;
+    // A seen card can still average 0 (zero amounts, or history decayed away): no ratio then
+    f[RuleInput::AMOUNT_RATIO * stride] = card.seen_before && card.avg_amount > 0 ? t.amount / card.avg_amount : 0.0;
+    f[RuleInput::SEEN_BEFORE * stride] = card.seen_before ? 1.0 : 0.0;
+    f[RuleInput::SECONDS_SINCE_LAST * stride] = card.seconds_since_last;
+    f[RuleInput::MERCHANT * stride] = t.merchant_id;
+    f[RuleInput::DIGIT_SUM * stride] = digits;
+}
+
+RuleInput RuleInput::from(const Transaction& t, const CardFeatures& card) {
+    RuleInput in;
+    extract_features(t, card, in.f, 1);
+    return in;
+}
+
+const char* RuleInput::name(int feature) {
+    return feature >= 0 && feature < NUM_FEATURES ? FEATURE_NAMES[feature] : "?";
+}
+
+void RuleBatch::add(const Transaction& t, const CardFeatures& card) {
+    extract_features(t, card, &f[0][size], CAPACITY);
+    size++;
+}
+
+static bool parse_number(const std::string& s, double& out) {
+    std::istringstream ss(s);
+    ss >> out;
+    return !ss.fail() && ss.eof();
+}
+
+bool RulePlan::compile(const std::string& text, const std::string& source, std::string& error) {
+    for (Group& g : groups_) g = Group();
+    digit_weight_ = 0.0;
+    threshold_ = 0.8;
+    std::vector<double> weights;
+    double step = 0.0, scale = 1.0, factor = 1.0;
+
+    std::istringstream in(text);
+    std::string line;
+    int line_no = 0;
+    while (std::getline(in, line)) {
+        line_no++;
+        size_t hash = line.find('#');
+        if (hash != std::string::npos) line.erase(hash);
+        std::istringstream ss(line);
+        std::vector<std::string> tok;
+        std::string t;
+        while (ss >> t) tok.push_back(t);
+        if (tok.empty()) continue;
+        std::string where = source + ":" + std::to_string(line_no) + ": ";
+        const std::string& key = tok[0];
+        double v;
+        if (key == "rule") {
+            if (tok.size() != 5) { error = where + "expected rule <feature> <op> <value> <score>"; return false; }
+            int feature = -1, op = -1;
+            for (int k = 0; k < RuleInput::NUM_FEATURES; k++) if (tok[1] == FEATURE_NAMES[k]) feature = k;
+            for (int k = 0; k < NUM_OPS; k++) if (tok[2] == OP_NAMES[k]) op = k;
+            double value, score;
+            if (feature < 0) { error = where + "unknown feature '" + tok[1] + "'"; return false; }
+            if (op < 0) { error = where + "unknown operator '" + tok[2] + "'"; return false; }
+            if (!parse_number(tok[3], value) || !parse_number(tok[4], score)) { error = where + "bad number"; return false; }
+            groups_[op].feature.push_back(feature);
+            groups_[op].value.push_back(value);
+            groups_[op].score.push_back(score);
+        } else if (key == "ml_weights") {
+            weights.clear();
+            for (size_t k = 1; k < tok.size(); k++) {
+                if (!parse_number(tok[k], v)) { error = where + "bad weight '" + tok[k] + "'"; return false; }
+                weights.push_back(v);
+            }
+        } else if (key == "digit_weight" || key == "ml_step" || key == "ml_scale" || key == "ml_factor" || key == "threshold") {
+            if (tok.size() != 2 || !parse_number(tok[1], v)) { error = where + "expected " + key + " <number>"; return false; }
+            if (key == "digit_weight") digit_weight_ = v;
+            else if (key == "ml_step") step = v;
+            else if (key == "ml_scale") scale = v;
+            else if (key == "ml_factor") factor = v;
+            else threshold_ = v;
+        } else {
+            error = where + "unknown directive '" + key + "'";
+            return false;
+        }
+    }
+    if (scale == 0.0) { error = source + ": ml_scale must not be 0"; return false; }
+
+    // sum_i w_i * (amount + i * step) / scale = amount * sum(w) / scale + step * sum(i * w_i) / scale
+    double sum_w = 0.0, sum_iw = 0.0;
+    for (size_t i = 0; i < weights.size(); i++) {
+        sum_w += weights[i];
+        sum_iw += i * weights[i];
+    }
+    ml_slope_ = factor * sum_w / scale;
+    ml_intercept_ = factor * step * sum_iw / scale;
+    return true;
+}
+
+size_t RulePlan::ruleCount() const {
+    size_t n = 0;
+    for (const Group& g : groups_) n += g.feature.size();
+    return n;
+}
+
+// One operator's rules over one transaction: a fixed comparison, no branches
+template <typename Cmp>
+static double eval_group(const std::vector<int>& feature, const std::vector<double>& value,
+                         const std::vector<double>& score, const double* f) {
+    Cmp cmp;
+    double s = 0.0;
+    for (size_t r = 0; r < feature.size(); r++) s += score[r] * cmp(f[feature[r]], value[r]);
+    return s;
+}
+
+// Same over a batch, rule by rule down each feature column
+template <typename Cmp>
+static void eval_group_batch(const std::vector<int>& feature, const std::vector<double>& value,
+                             const std::vector<double>& score, const RuleBatch& batch, double* out) {
+    Cmp cmp;
+    for (size_t r = 0; r < feature.size(); r++) {
+        const double* col = batch.f[feature[r]];
+        double v = value[r], sc = score[r];
+        for (size_t t = 0; t < batch.size; t++) out[t] += sc * cmp(col[t], v);
+    }
+}
+
+double RulePlan::score(const RuleInput& in) const {
+    const double* f = in.f;
+    double s = digit_weight_ * f[RuleInput::DIGIT_SUM] + ml_slope_ * f[RuleInput::AMOUNT] + ml_intercept_;
+    s += eval_group<std::greater<double>>(groups_[GT].feature, groups_[GT].value, groups_[GT].score, f);
+    s += eval_group<std::greater_equal<double>>(groups_[GE].feature, groups_[GE].value, groups_[GE].score, f);
+    s += eval_group<std::less<double>>(groups_[LT].feature, groups_[LT].value, groups_[LT].score, f);
+    s += eval_group<std::less_equal<double>>(groups_[LE].feature, groups_[LE].value, groups_[LE].score, f);
+    s += eval_group<std::equal_to<double>>(groups_[EQ].feature, groups_[EQ].value, groups_[EQ].score, f);
+    s += eval_group<std::not_equal_to<double>>(groups_[NE].feature, groups_[NE].value, groups_[NE].score, f);
+    return s;
+}
+
+void RulePlan::scoreBatch(const RuleBatch& batch, double* out) const {
+    for (size_t t = 0; t < batch.size; t++) {
+        out[t] = digit_weight_ * batch.f[RuleInput::DIGIT_SUM][t] + ml_slope_ * batch.f[RuleInput::AMOUNT][t] + ml_intercept_;
+    }
+    eval_group_batch<std::greater<double>>(groups_[GT].feature, groups_[GT].value, groups_[GT].score, batch, out);
+    eval_group_batch<std::greater_equal<double>>(groups_[GE].feature, groups_[GE].value, groups_[GE].score, batch, out);
+    eval_group_batch<std::less<double>>(groups_[LT].feature, groups_[LT].value, groups_[LT].score, batch, out);
+    eval_group_batch<std::less_equal<double>>(groups_[LE].feature, groups_[LE].value, groups_[LE].score, batch, out);
+    eval_group_batch<std::equal_to<double>>(groups_[EQ].feature, groups_[EQ].value, groups_[EQ].score, batch, out);
+    eval_group_batch<std::not_equal_to<double>>(groups_[NE].feature, groups_[NE].value, groups_[NE].score, batch, out);
+}
+
+bool FraudRules::load(const std::string& path, std::string& error) {
+    path_ = path;
+    return reload(error);
+}
+
+bool FraudRules::reload(std::string& error) {
+    std::string text = RulePlan::DEFAULTS;
+    std::string source = "built-in rules";
+    if (!path_.empty()) {
+        std::ifstream in(path_);
+        if (!in.is_open()) { error = "cannot read " + path_; return false; }
+        std::stringstream ss;
+        ss << in.rdbuf();
+        text = ss.str();
+        source = path_;
+    }
+    std::shared_ptr<RulePlan> plan(new RulePlan);
+    if (!plan->compile(text, source, error)) return false;
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_ = plan;
+    version_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+const RulePlan& FraudRules::plan() {
+    struct Cached {
+        std::shared_ptr<const RulePlan> plan;
+        uint64_t version = 0;
+    };
+    static thread_local Cached cached;
+    if (version_.load(std::memory_order_relaxed) != cached.version) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cached.plan = current_;
+        cached.version = version_.load(std::memory_order_relaxed);
+    }
+    return *cached.plan;
+}
+
+// Modification stamp of the file, or an empty string if it cannot be read
+static std::string file_stamp(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return std::string();
+    return std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec) + "/" + std::to_string(st.st_size);
+}
+
+void FraudRules::watch(int interval_ms) {
+    if (path_.empty() || interval_ms <= 0) return;
+    // Runs for the life of the process, like the stats server
+    std::thread([this, interval_ms]() {
+        std::string loaded = file_stamp(path_);
+        std::string seen = loaded;
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+            std::string stamp = file_stamp(path_);
+            // Reload once a change has held still for a poll, so a file caught mid-write is not compiled
+            if (stamp.empty() || stamp == loaded) { seen = stamp; continue; }
+            if (stamp != seen) { seen = stamp; continue; }
+            std::string error;
+            if (reload(error)) {
+                std::cout << "Reloaded fraud rules from " << path_ << " (" << plan().ruleCount() << " rules)" << std::endl;
+            } else {
+                std::cerr << "Keeping current fraud rules: " << error << std::endl;
+            }
+            loaded = stamp;
+        }
+    }).detach();
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../common/transaction.h"
+#include "card_cache.h"
+
+// Fraud rules and model weights loaded from a config file (--rules FILE), one directive per line:
+//     # rule <feature> <op> <value> <score>     op is one of > >= < <= == !=
+//     rule amount > 10000 0.3
+//     rule amount_ratio > 5 0.2                 # amount vs the card's average (0 while it averages 0)
+//     digit_weight 0.001                        # times the sum of the card number's digits
+//     ml_weights 0.1 0.2 0.15 0.3 0.05 0.1 0.2 0.15 0.05 0.1
+//     ml_step 100                               # model input i is (amount + i * step) / scale
+//     ml_scale 10000
+//     ml_factor 0.1                             # weight of the model output in the score
+//     threshold 0.8                             # transactions scoring below this pass
+// Without --rules the built-in defaults below reproduce the original hardcoded policy.
+// - compile() turns the text into a flat RulePlan: rules are grouped by operator into
+//   feature / value / score columns, and each group is evaluated by a loop specialized
+//   for its operator that adds score * (feature op value), without branches
+// - The model is linear in the amount, so its weight vector folds into two constants at
+//   compile time, and the digit rule into one multiply
+// - scoreBatch() evaluates the plan column-wise over up to RuleBatch::CAPACITY transactions
+// - Hot reload: FraudRules polls the file and swaps in a newly compiled plan. A transaction
+//   already being scored finishes on the plan it started with; a file that does not
+//   compile is reported and the current plan stays
+
+// Inputs the rules can refer to, by name in the config file
+struct RuleInput {
+    enum Feature {
+        AMOUNT, CARD_LENGTH, VELOCITY, AVG_AMOUNT, AMOUNT_RATIO, SEEN_BEFORE,
+        SECONDS_SINCE_LAST, MERCHANT, DIGIT_SUM, NUM_FEATURES
+    };
+    double f[NUM_FEATURES];
+
+    static RuleInput from(const Transaction& t, const CardFeatures& card);
+    static const char* name(int feature);
+};
+
+// Feature columns of up to CAPACITY transactions for the batched evaluator
+struct RuleBatch {
+    static const size_t CAPACITY = 64;
+    double f[RuleInput::NUM_FEATURES][CAPACITY];
+    size_t size = 0;
+
+    void add(const Transaction& t, const CardFeatures& card);
+};
+
+class RulePlan {
+public:
+    enum Op { GT, GE, LT, LE, EQ, NE, NUM_OPS };
+
+    // Parse and compile config text; source names it in errors ("file:line: ...")
+    bool compile(const std::string& text, const std::string& source, std::string& error);
+
+    // Rules, digit and model terms of the score (the consumer adds its simulated lookup term)
+    double score(const RuleInput& in) const;
+    void scoreBatch(const RuleBatch& batch, double* out) const;
+
+    double threshold() const { return threshold_; }
+    size_t ruleCount() const;
+
+    static const char* DEFAULTS;
+
+private:
+    // One operator's rules as columns
+    struct Group {
+        std::vector<int> feature;
+        std::vector<double> value;
+        std::vector<double> score;
+    };
+
+    Group groups_[NUM_OPS];
+    double digit_weight_ = 0.0;
+    double ml_slope_ = 0.0;       // model term = ml_slope_ * amount + ml_intercept_
+    double ml_intercept_ = 0.0;
+    double threshold_ = 0.8;
+};
+
+class FraudRules {
+public:
+    // Compile the file, or the defaults if path is empty; on failure error says why
+    bool load(const std::string& path, std::string& error);
+
+    // Poll the file every interval_ms from a background thread and reload it when it changes
+    void watch(int interval_ms);
+
+    // Current plan for the calling thread. Each thread keeps its own reference and only
+    // takes the lock after a reload, so the common case is one relaxed atomic load.
+    // One FraudRules per process.
+    const RulePlan& plan();
+
+    uint64_t version() const { return version_.load(std::memory_order_relaxed); }
+
+private:
+    bool reload(std::string& error);
+
+    std::string path_;
+    std::mutex mutex_;
+    std::shared_ptr<const RulePlan> current_;
+    std::atomic<uint64_t> version_{0};
+};
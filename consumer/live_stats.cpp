@@ -0,0 +1,316 @@
+#include "live_stats.h"
+#include "../common/utils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static int location_index(const std::string& location) {
+    const std::vector<std::string>& known = Utils::getLocations();
+    for (size_t i = 0; i < known.size(); i++) {
+        if (known[i] == location) return static_cast<int>(i);
+    }
+    return static_cast<int>(known.size());   // "other"
+}
+
+LiveStats::Shard::Shard() : locations(Utils::getLocations().size() + 1), rng(std::random_device{}()) {
+    sample.reserve(RESERVOIR_SIZE);
+}
+
+void LiveStats::Shard::record(const Transaction& t, double fraud_score, bool is_valid) {
+    uint64_t cents = static_cast<uint64_t>(std::llround(t.amount * 100.0));
+    total.add(1);
+    total_cents.add(cents);
+    if (is_valid) {
+        valid.add(1);
+        valid_cents.add(cents);
+    } else {
+        invalid.add(1);
+    }
+
+    Bucket& m = merchants[t.merchant_id >= 1 && t.merchant_id <= MAX_MERCHANT ? t.merchant_id : 0];
+    m.count.add(1);
+    m.cents.add(cents);
+    Bucket& l = locations[location_index(t.location)];
+    l.count.add(1);
+    l.cents.add(cents);
+    if (!is_valid) {
+        m.invalid.add(1);
+        l.invalid.add(1);
+    }
+
+    int bucket = fraud_score > 0 ? static_cast<int>(fraud_score * 10) : 0;
+    score_buckets[std::min(bucket, NUM_SCORE_BUCKETS - 1)].add(1);
+
+    if (is_valid) return;
+    // Algorithm R: the k-th invalid transaction replaces a random slot with probability RESERVOIR_SIZE/k
+    invalid_seen++;
+    if (invalid_seen <= RESERVOIR_SIZE) {
+        std::lock_guard<std::mutex> lock(sample_mu);
+        sample.push_back(t);
+        return;
+    }
+    uint64_t slot = rng() % invalid_seen;
+    if (slot < RESERVOIR_SIZE) {
+        std::lock_guard<std::mutex> lock(sample_mu);
+        sample[slot] = t;
+    }
+}
+
+void LiveStats::ShardDeleter::operator()(Shard* s) const {
+    s->~Shard();
+    std::free(s);
+}
+
+LiveStats::LiveStats() : num_shards_(0) {}
+
+LiveStats::Shard& LiveStats::addShard() {
+    std::lock_guard<std::mutex> lock(add_mu_);
+    int idx = num_shards_.load(std::memory_order_relaxed);
+    if (idx >= MAX_SHARDS) {
+        // A shard has a single writer; sharing one would lose counts and race on the reservoir
+        throw std::length_error("LiveStats: more than " + std::to_string(MAX_SHARDS) + " shards");
+    }
+    void* mem = nullptr;
+    if (posix_memalign(&mem, 64, sizeof(Shard)) != 0) throw std::bad_alloc();
+    shards_[idx].reset(new (mem) Shard());
+    // Publish only after construction so readers never see a half-built shard
+    num_shards_.store(idx + 1, std::memory_order_release);
+    return *shards_[idx];
+}
+
+LiveStats::Snapshot LiveStats::snapshot() const {
+    Snapshot s;
+    s.merchants.resize(MAX_MERCHANT + 1);
+    s.location_names = Utils::getLocations();
+    s.location_names.push_back("other");
+    s.locations.resize(s.location_names.size());
+    s.score_buckets.assign(NUM_SCORE_BUCKETS, 0);
+
+    // Per-shard samples and how many invalid transactions each one stands for
+    std::vector<std::vector<Transaction>> samples;
+    std::vector<uint64_t> weights;
+
+    int n = num_shards_.load(std::memory_order_acquire);
+    for (int i = 0; i < n; i++) {
+        const Shard& sh = *shards_[i];
+        s.total += sh.total.get();
+        s.valid += sh.valid.get();
+        s.invalid += sh.invalid.get();
+        s.total_cents += static_cast<int64_t>(sh.total_cents.get());
+        s.valid_cents += static_cast<int64_t>(sh.valid_cents.get());
+        for (int m = 0; m <= MAX_MERCHANT; m++) {
+            s.merchants[m].count += sh.merchants[m].count.get();
+            s.merchants[m].invalid += sh.merchants[m].invalid.get();
+            s.merchants[m].cents += static_cast<int64_t>(sh.merchants[m].cents.get());
+        }
+        for (size_t l = 0; l < s.locations.size(); l++) {
+            s.locations[l].count += sh.locations[l].count.get();
+            s.locations[l].invalid += sh.locations[l].invalid.get();
+            s.locations[l].cents += static_cast<int64_t>(sh.locations[l].cents.get());
+        }
+        for (int b = 0; b < NUM_SCORE_BUCKETS; b++) s.score_buckets[b] += sh.score_buckets[b].get();
+
+        std::lock_guard<std::mutex> lock(sh.sample_mu);
+        samples.push_back(sh.sample);
+        weights.push_back(sh.invalid.get());
+    }
+
+    // Merge reservoirs: draw each slot from a shard chosen in proportion to its invalid count
+    std::mt19937_64 rng(s.invalid);
+    while (s.invalid_sample.size() < RESERVOIR_SIZE) {
+        uint64_t remaining = 0;
+        for (size_t i = 0; i < samples.size(); i++) remaining += samples[i].empty() ? 0 : weights[i];
+        if (remaining == 0) break;
+        uint64_t pick = rng() % remaining;
+        size_t i = 0;
+        while (samples[i].empty() || pick >= weights[i]) {
+            if (!samples[i].empty()) pick -= weights[i];
+            i++;
+        }
+        size_t j = rng() % samples[i].size();
+        s.invalid_sample.push_back(samples[i][j]);
+        samples[i][j] = samples[i].back();
+        samples[i].pop_back();
+    }
+    return s;
+}
+
+// Card and location come straight from the wire, so quote them defensively
+static std::string json_escape(const std::string& in) {
+    std::string out;
+    for (char c : in) {
+        if (c == '"' || c == '\\') { out.push_back('\\'); out.push_back(c); }
+        else if (static_cast<unsigned char>(c) >= 0x20) out.push_back(c);
+    }
+    return out;
+}
+
+static void json_row(std::ostringstream& json, const LiveStats::Snapshot::Row& r) {
+    json << "\"count\": " << r.count << ", \"invalid\": " << r.invalid
+         << ", \"amount\": " << r.cents / 100.0;
+}
+
+std::string LiveStats::toJson(size_t top_merchants) const {
+    Snapshot s = snapshot();
+    std::ostringstream json;
+    json << std::fixed << std::setprecision(2);
+    json << "{\n";
+    json << "  \"totals\": {\"transactions\": " << s.total << ", \"valid\": " << s.valid
+         << ", \"invalid\": " << s.invalid << ", \"amount\": " << s.total_cents / 100.0
+         << ", \"valid_amount\": " << s.valid_cents / 100.0 << "},\n";
+
+    json << "  \"locations\": [";
+    for (size_t l = 0; l < s.locations.size(); l++) {
+        json << (l ? "," : "") << "\n    {\"location\": \"" << json_escape(s.location_names[l]) << "\", ";
+        json_row(json, s.locations[l]);
+        json << "}";
+    }
+    json << "\n  ],\n";
+
+    json << "  \"fraud_score_buckets\": [";
+    for (int b = 0; b < NUM_SCORE_BUCKETS; b++) {
+        json << (b ? ", " : "") << "{\"min\": " << b / 10.0 << ", \"count\": " << s.score_buckets[b] << "}";
+    }
+    json << "],\n";
+
+    // Merchants by transaction count (ties by id)
+    std::vector<int> ids;
+    for (int m = 0; m <= MAX_MERCHANT; m++) {
+        if (s.merchants[m].count > 0) ids.push_back(m);
+    }
+    std::stable_sort(ids.begin(), ids.end(), [&](int a, int b) {
+        return s.merchants[a].count > s.merchants[b].count;
+    });
+    if (top_merchants > 0 && ids.size() > top_merchants) ids.resize(top_merchants);
+    json << "  \"merchants\": [";
+    for (size_t i = 0; i < ids.size(); i++) {
+        json << (i ? "," : "") << "\n    {\"merchant_id\": " << ids[i] << ", ";
+        json_row(json, s.merchants[ids[i]]);
+        json << "}";
+    }
+    json << "\n  ],\n";
+
+    json << "  \"invalid_sample\": [";
+    for (size_t i = 0; i < s.invalid_sample.size(); i++) {
+        const Transaction& t = s.invalid_sample[i];
+        json << (i ? "," : "") << "\n    {\"id\": " << t.transaction_id << ", \"card\": \"" << json_escape(t.card_number)
+             << "\", \"amount\": " << t.amount << ", \"merchant_id\": " << t.merchant_id
+             << ", \"location\": \"" << json_escape(t.location) << "\"}";
+    }
+    json << "\n  ]\n";
+    json << "}";
+    return json.str();
+}
+
+void LiveStats::print() const {
+    Snapshot s = snapshot();
+    std::cout << "\n=== Transaction Statistics ===" << std::endl;
+    std::cout << "Total Transactions: " << s.total << std::endl;
+    std::cout << "Valid Transactions: " << s.valid
+              << " (" << (s.total > 0 ? (s.valid * 100.0 / s.total) : 0)
+              << "%)" << std::endl;
+    std::cout << "Invalid Transactions: " << s.invalid
+              << " (" << (s.total > 0 ? (s.invalid * 100.0 / s.total) : 0)
+              << "%)" << std::endl;
+    std::cout << "Total Amount: $" << std::fixed << std::setprecision(2) << s.total_cents / 100.0 << std::endl;
+    std::cout << "Valid Amount: $" << std::fixed << std::setprecision(2) << s.valid_cents / 100.0 << std::endl;
+    std::cout << "Average Transaction: $" << std::fixed << std::setprecision(2)
+              << (s.total > 0 ? s.total_cents / 100.0 / s.total : 0) << std::endl;
+    std::cout << "Average Valid Transaction: $" << std::fixed << std::setprecision(2)
+              << (s.valid > 0 ? s.valid_cents / 100.0 / s.valid : 0) << std::endl;
+}
+
+void LiveStats::printInvalidSample() const {
+    Snapshot s = snapshot();
+    if (s.invalid_sample.empty()) return;
+    std::cout << "\n=== Sample Invalid Transactions ===" << std::endl;
+    size_t samplesToShow = std::min<size_t>(5, s.invalid_sample.size());
+    for (size_t i = 0; i < samplesToShow; i++) {
+        const auto& t = s.invalid_sample[i];
+        std::cout << "ID: " << t.transaction_id
+                  << ", Card: " << t.card_number
+                  << ", Amount: $" << t.amount;
+        if (t.amount <= 0) {
+            std::cout << " [Invalid: Amount <= 0]";
+        } else if (!Utils::luhnCheck(t.card_number)) {
+            std::cout << " [Invalid: Failed Luhn check]";
+        }
+        std::cout << std::endl;
+    }
+    if (s.invalid > samplesToShow) {
+        std::cout << "... and " << (s.invalid - samplesToShow) << " more invalid transactions" << std::endl;
+    }
+}
+
+// A client that does not send its request or take the response within this long is
+// dropped, so an idle connection cannot hold up the single server thread for long
+static const int REQUEST_TIMEOUT_MS = 1000;
+
+static void serve_stats_request(int client_fd, const LiveStats& stats) {
+    timeval tv{REQUEST_TIMEOUT_MS / 1000, (REQUEST_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    char buffer[1024];
+    ssize_t n = recv(client_fd, buffer, sizeof(buffer) - 1, 0);
+    if (n <= 0) {
+        close(client_fd);
+        return;
+    }
+    buffer[n] = '\0';
+
+    std::string request(buffer);
+    std::ostringstream response;
+    if (request.compare(0, 20, "GET /stats/merchants") == 0 || request.compare(0, 10, "GET /stats") == 0) {
+        bool all = request.compare(0, 20, "GET /stats/merchants") == 0;
+        std::string json = stats.toJson(all ? 0 : 10);
+        response << "HTTP/1.1 200 OK\r\n";
+        response << "Content-Type: application/json\r\n";
+        response << "Access-Control-Allow-Origin: *\r\n";
+        response << "Content-Length: " << json.length() << "\r\n";
+        response << "Connection: close\r\n";
+        response << "\r\n";
+        response << json;
+    } else {
+        response << "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    }
+    std::string resp_str = response.str();
+    send(client_fd, resp_str.c_str(), resp_str.length(), MSG_NOSIGNAL);
+    close(client_fd);
+}
+
+bool start_stats_server(uint16_t port, const LiveStats& stats) {
+    int server_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) { perror("socket"); return false; }
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(server_fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(server_fd, 16) < 0) {
+        perror("stats http");
+        close(server_fd);
+        return false;
+    }
+    // Requests are rare and small, so one thread serving them in turn is plenty; it dies
+    // with the process
+    std::thread([server_fd, &stats]() {
+        while (true) {
+            int fd = accept(server_fd, nullptr, nullptr);
+            if (fd < 0) continue;
+            serve_stats_request(fd, stats);
+        }
+    }).detach();
+    std::cout << "Live statistics at http://0.0.0.0:" << port << "/stats" << std::endl;
+    return true;
+}
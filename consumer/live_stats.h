@@ -0,0 +1,88 @@
+#pragma once
+#include "../common/transaction.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+// Live consumer statistics, cheap enough to update for every transaction.
+// - Each processing thread owns one cache-line-aligned shard and is its only writer,
+//   so counters are bumped with a relaxed load + store: no locked instructions, no sharing
+// - Readers (the HTTP endpoint, the exit report) sum all shards on demand
+// - Aggregates per merchant, per location and per fraud-score bucket
+// - Invalid transactions are kept as a fixed-size reservoir sample (Algorithm R) per shard
+
+class LiveStats {
+public:
+    static const int MAX_MERCHANT = 999;        // ids outside 1..999 are counted under 0
+    static const int NUM_SCORE_BUCKETS = 11;    // [0, 0.1) ... [0.9, 1.0), >= 1.0
+    static const size_t RESERVOIR_SIZE = 32;
+    static const int MAX_SHARDS = 64;
+
+    // Single-writer counter: the owning thread adds, anyone may read
+    struct Counter {
+        std::atomic<uint64_t> v{0};
+        void add(uint64_t d) { v.store(v.load(std::memory_order_relaxed) + d, std::memory_order_relaxed); }
+        uint64_t get() const { return v.load(std::memory_order_relaxed); }
+    };
+
+    struct Bucket {
+        Counter count;
+        Counter invalid;
+        Counter cents;           // two's-complement sum of amounts in cents
+    };
+
+    struct alignas(64) Shard {
+        Counter total, valid, invalid;
+        Counter total_cents, valid_cents;
+        Bucket merchants[MAX_MERCHANT + 1];
+        std::vector<Bucket> locations;      // one per Utils::getLocations() entry, plus "other"
+        Counter score_buckets[NUM_SCORE_BUCKETS];
+
+        // Reservoir: writer-owned bookkeeping, the mutex only guards the sample itself
+        uint64_t invalid_seen = 0;
+        std::mt19937_64 rng;
+        mutable std::mutex sample_mu;
+        std::vector<Transaction> sample;
+
+        Shard();
+        void record(const Transaction& t, double fraud_score, bool valid);
+    };
+
+    // Merged view across shards
+    struct Snapshot {
+        uint64_t total = 0, valid = 0, invalid = 0;
+        int64_t total_cents = 0, valid_cents = 0;
+        struct Row { uint64_t count = 0, invalid = 0; int64_t cents = 0; };
+        std::vector<Row> merchants;          // index = merchant id, 0 = out of range
+        std::vector<std::string> location_names;
+        std::vector<Row> locations;
+        std::vector<uint64_t> score_buckets;
+        std::vector<Transaction> invalid_sample;
+    };
+
+    LiveStats();
+
+    // Called once by each processing thread; the shard lives as long as the LiveStats.
+    // At most MAX_SHARDS, then std::length_error: a shard must never have two writers
+    Shard& addShard();
+
+    Snapshot snapshot() const;
+    std::string toJson(size_t top_merchants) const;   // 0 = every merchant seen
+    void print() const;                                 // exit report on stdout
+    void printInvalidSample() const;
+
+private:
+    // Shards are allocated 64-byte aligned so neighbouring threads never share a line
+    struct ShardDeleter { void operator()(Shard* s) const; };
+    std::unique_ptr<Shard, ShardDeleter> shards_[MAX_SHARDS];
+    std::atomic<int> num_shards_;
+    std::mutex add_mu_;
+};
+
+// Serve GET /stats (top merchants) and GET /stats/merchants (all of them) as JSON from a
+// background thread. Returns false if the port cannot be bound.
+bool start_stats_server(uint16_t port, const LiveStats& stats);
@@ -0,0 +1,563 @@
+#include "../common/transaction.h"
+#include "../common/utils.h"
+#include "../common/clock.h"
+#include "../common/batch_codec.h"
+#include "../common/trace.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// End-to-end load test: starts a broker and N consumers as child processes on loopback,
+// acts as the producer itself, and reports throughput, latency percentiles, redeliveries
+// and CPU time per component.
+// - Each run gets a fresh working directory so broker_log.txt starts empty
+// - Latency = consumer ACK time (from --latency-out records) minus our send time
+// - Optionally kills consumer 0 mid-run and restarts it to measure recovery
+// - --low-latency runs broker and consumers in their low-latency mode (broker on cpu 0,
+//   consumers on the following cores), so two runs compare the latency distributions
+// - --trace-sample N traces 1 in N messages through every component and merges their
+//   Chrome trace files into <run dir>/trace.json
+
+struct Config {
+    int consumers = 4;
+    long count = 100000;
+    long rate = 0;                 // messages/sec, 0 = as fast as possible
+    long kill_after_ms = 0;        // 0 = no kill
+    long restart_delay_ms = 500;
+    long timeout_s = 300;
+    uint16_t base_port = 19100;    // producer port; consumer = +1, monitor = +2
+    std::string format = "json";
+    std::string out_path;          // empty = stdout
+    std::string bin_dir;
+    bool keep_dir = false;
+    bool shm = false;              // consumers attach over shared memory instead of TCP
+    long batch = 0;                // >0 = send columnar batches of this many messages
+    bool low_latency = false;      // broker and consumers pinned and busy-polling
+    uint64_t trace_sample = 0;     // trace 1 in N messages, 0 = off
+    std::vector<std::string> broker_args;  // extra options passed through to the broker
+    std::vector<std::string> consumer_args;  // extra options passed through to every consumer
+};
+
+struct Child {
+    pid_t pid = -1;
+    std::string name;
+    double cpu_s = 0.0;
+    bool reaped = false;
+};
+
+static long long now_ns() {
+    return Clock::monotonicNs();
+}
+
+static double rusage_seconds(const rusage& ru) {
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+           ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+static std::string default_bin_dir() {
+    char path[PATH_MAX];
+    ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (n <= 0) return ".";
+    path[n] = '\0';
+    std::string s(path);
+    size_t slash = s.rfind('/');
+    return slash == std::string::npos ? "." : s.substr(0, slash);
+}
+
+static void usage(const char* prog) {
+    std::cerr << "Usage: " << prog << " [options]\n"
+              << "  --consumers N         number of consumer processes (default 4)\n"
+              << "  --count N             messages to send (default 100000)\n"
+              << "  --rate R              target send rate in msgs/sec, 0 = unlimited (default 0)\n"
+              << "  --kill-after-ms T     SIGKILL consumer 0 after T ms, 0 = never (default 0)\n"
+              << "  --restart-delay-ms D  restart the killed consumer after D ms (default 500)\n"
+              << "  --timeout-s S         give up waiting for ACKs after S seconds (default 300)\n"
+              << "  --base-port P         producer port P, consumer P+1, monitor P+2 (default 19100)\n"
+              << "  --format csv|json     report format (default json)\n"
+              << "  --out FILE            write report to FILE instead of stdout\n"
+              << "  --bin-dir DIR         directory holding broker/consumer binaries\n"
+              << "  --broker-arg ARG      extra broker option, repeatable (e.g. --broker-arg --lane-weights --broker-arg 4,1)\n"
+              << "  --consumer-arg ARG    extra consumer option, repeatable\n"
+              << "  --keep-dir            keep the run directory with child logs\n"
+              << "  --shm                 consumers use the broker's shared-memory rings instead of TCP\n"
+              << "  --batch N             send columnar batches of N messages instead of text lines\n"
+              << "  --low-latency         pin and busy-poll broker (cpu 0) and consumers (cpu 1, 2, ...)\n"
+              << "  --trace-sample N      trace 1 in N messages, merged into <run dir>/trace.json (keeps the dir)\n";
+}
+
+static bool parse_args(int argc, char* argv[], Config& cfg) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--keep-dir") { cfg.keep_dir = true; continue; }
+        if (arg == "--shm") { cfg.shm = true; continue; }
+        if (arg == "--low-latency") { cfg.low_latency = true; continue; }
+        if (i + 1 >= argc) { usage(argv[0]); return false; }
+        std::string val = argv[++i];
+        if (arg == "--consumers") cfg.consumers = std::stoi(val);
+        else if (arg == "--count") cfg.count = std::stol(val);
+        else if (arg == "--rate") cfg.rate = std::stol(val);
+        else if (arg == "--batch") cfg.batch = std::stol(val);
+        else if (arg == "--trace-sample") cfg.trace_sample = std::stoull(val);
+        else if (arg == "--kill-after-ms") cfg.kill_after_ms = std::stol(val);
+        else if (arg == "--restart-delay-ms") cfg.restart_delay_ms = std::stol(val);
+        else if (arg == "--timeout-s") cfg.timeout_s = std::stol(val);
+        else if (arg == "--base-port") cfg.base_port = static_cast<uint16_t>(std::stoi(val));
+        else if (arg == "--format") cfg.format = val;
+        else if (arg == "--out") cfg.out_path = val;
+        else if (arg == "--bin-dir") cfg.bin_dir = val;
+        else if (arg == "--broker-arg") cfg.broker_args.push_back(val);
+        else if (arg == "--consumer-arg") cfg.consumer_args.push_back(val);
+        else { usage(argv[0]); return false; }
+    }
+    if (cfg.consumers < 1 || cfg.count < 1 || (cfg.format != "csv" && cfg.format != "json")) {
+        usage(argv[0]);
+        return false;
+    }
+    return true;
+}
+
+// fork/exec a component with its working directory and output redirected into run_dir
+static pid_t spawn(const std::string& run_dir, const std::string& log_name, const std::vector<std::string>& args) {
+    pid_t pid = fork();
+    if (pid < 0) { perror("fork"); return -1; }
+    if (pid == 0) {
+        if (chdir(run_dir.c_str()) != 0) _exit(127);
+        int fd = open(log_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) { dup2(fd, 1); dup2(fd, 2); close(fd); }
+        std::vector<char*> cargs;
+        for (const auto& a : args) cargs.push_back(const_cast<char*>(a.c_str()));
+        cargs.push_back(nullptr);
+        execv(cargs[0], cargs.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+static void reap(Child& c) {
+    if (c.reaped || c.pid < 0) return;
+    int status = 0;
+    rusage ru{};
+    pid_t r = wait4(c.pid, &status, 0, &ru);
+    if (r == c.pid) {
+        c.cpu_s = rusage_seconds(ru);
+        c.reaped = true;
+    }
+}
+
+static int connect_loopback(uint16_t port) {
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) { close(fd); return -1; }
+    return fd;
+}
+
+static int send_all(int fd, const char* data, size_t len) {
+    size_t total = 0;
+    while (total < len) {
+        ssize_t n = send(fd, data + total, len - total, 0);
+        if (n <= 0) return -1;
+        total += (size_t)n;
+    }
+    return 0;
+}
+
+// Read one broker counter ("total_acked", "redelivered", ...) from the monitor; -1 on failure
+static long long query_status(uint16_t monitor_port, const std::string& field) {
+    int fd = connect_loopback(monitor_port);
+    if (fd < 0) return -1;
+    const char* req = "GET /status HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    send_all(fd, req, strlen(req));
+    std::string resp;
+    char buf[4096];
+    ssize_t n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) resp.append(buf, n);
+    close(fd);
+    const std::string key = "\"" + field + "\": ";
+    size_t pos = resp.find(key);
+    if (pos == std::string::npos) return -1;
+    return std::strtoll(resp.c_str() + pos + key.size(), nullptr, 10);
+}
+
+// Sum of "requeuing N messages" reported by the broker on consumer disconnects
+static long long count_requeued(const std::string& broker_log) {
+    std::ifstream in(broker_log);
+    std::string line;
+    long long total = 0;
+    const std::string key = "(requeuing ";
+    while (std::getline(in, line)) {
+        size_t pos = line.find(key);
+        if (pos != std::string::npos) total += std::strtoll(line.c_str() + pos + key.size(), nullptr, 10);
+    }
+    return total;
+}
+
+static double percentile(const std::vector<long long>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(idx, sorted.size() - 1)] / 1000.0;  // ns -> us
+}
+
+// Concatenate the event arrays of the components' trace files into one file; files of
+// components that were killed are missing and skipped
+static size_t merge_traces(const std::string& run_dir, const std::vector<std::string>& names, const std::string& out_path) {
+    std::ofstream out(out_path);
+    out << "[";
+    size_t merged = 0;
+    for (const auto& name : names) {
+        std::ifstream in(run_dir + "/" + name + ".trace.json");
+        if (!in.is_open()) continue;
+        std::stringstream ss;
+        ss << in.rdbuf();
+        std::string body = ss.str();
+        size_t open = body.find('['), close = body.rfind(']');
+        if (open == std::string::npos || close == std::string::npos || close <= open) continue;
+        out << (merged ? "," : "") << body.substr(open + 1, close - open - 1);
+        merged++;
+    }
+    out << "]\n";
+    return merged;
+}
+
+// Average throughput over [from_ms, to_ms) using the sampled ACK timeline
+static double window_rate(const std::vector<std::pair<long long, long long>>& timeline, long long from_ms, long long to_ms) {
+    long long a0 = -1, a1 = -1, t0 = 0, t1 = 0;
+    for (const auto& s : timeline) {
+        if (s.first >= from_ms && a0 < 0) { a0 = s.second; t0 = s.first; }
+        if (s.first <= to_ms) { a1 = s.second; t1 = s.first; }
+    }
+    if (a0 < 0 || a1 < 0 || t1 <= t0) return 0.0;
+    return (a1 - a0) * 1000.0 / (t1 - t0);
+}
+
+int main(int argc, char* argv[]) {
+    Config cfg;
+    if (!parse_args(argc, argv, cfg)) return 1;
+    if (cfg.bin_dir.empty()) cfg.bin_dir = default_bin_dir();
+    signal(SIGPIPE, SIG_IGN);
+
+    char dir_template[] = "/tmp/loadtest.XXXXXX";
+    if (!mkdtemp(dir_template)) { perror("mkdtemp"); return 1; }
+    std::string run_dir = dir_template;
+
+    uint16_t prod_port = cfg.base_port;
+    uint16_t cons_port = cfg.base_port + 1;
+    uint16_t mon_port = cfg.base_port + 2;
+    std::string broker_bin = cfg.bin_dir + "/broker";
+    std::string consumer_bin = cfg.bin_dir + "/consumer";
+
+    std::cerr << "=== Load Test ===" << std::endl;
+    std::cerr << "Run directory: " << run_dir << std::endl;
+    if (cfg.trace_sample) {
+        Trace::configure(cfg.trace_sample, "loadtest (producer)", Trace::FIRST, run_dir + "/loadtest.trace.json");
+        cfg.keep_dir = true;
+    }
+
+    // Pre-generate the workload so generation cost stays out of the measurement
+    // Each unit is one text line, or one framed batch with --batch
+    std::vector<Transaction> txns;
+    txns.reserve(cfg.count);
+    for (long i = 0; i < cfg.count; i++) {
+        txns.emplace_back(i + 1, Utils::generateCreditCardNumber(), Utils::generateRandomAmount(),
+                          Utils::generateMerchantId(), Utils::getRandomLocation());
+    }
+    long per_unit = cfg.batch > 0 ? cfg.batch : 1;
+    std::vector<std::string> units;
+    for (long i = 0; i < cfg.count; i += per_unit) {
+        if (cfg.batch > 0) {
+            size_t end = static_cast<size_t>(std::min(cfg.count, i + per_unit));
+            std::string payload = BatchCodec::encode(txns, i, end);
+            if (payload.size() > BatchCodec::MAX_BATCH_BYTES) {
+                std::cerr << "--batch " << cfg.batch << " encodes to more than " << BatchCodec::MAX_BATCH_BYTES
+                          << " bytes, the broker's frame limit; use a smaller batch" << std::endl;
+                return 1;
+            }
+            units.push_back(BatchCodec::frame(payload));
+        } else {
+            units.push_back(txns[i].serialize() + "\n");
+        }
+    }
+
+    Child broker;
+    broker.name = "broker";
+    std::vector<std::string> broker_argv = {broker_bin, std::to_string(prod_port),
+                                            std::to_string(cons_port), std::to_string(mon_port)};
+    broker_argv.insert(broker_argv.end(), cfg.broker_args.begin(), cfg.broker_args.end());
+    if (cfg.low_latency) {
+        broker_argv.push_back("--low-latency");
+        broker_argv.push_back("0");
+    }
+    if (cfg.trace_sample) {
+        broker_argv.insert(broker_argv.end(), {"--trace-sample", std::to_string(cfg.trace_sample), "--trace-out", "broker.trace.json"});
+    }
+    if (cfg.shm) {
+        broker_argv.push_back("--shm-socket");
+        broker_argv.push_back("broker.sock");
+    }
+    broker.pid = spawn(run_dir, "broker.out", broker_argv);
+    if (broker.pid < 0) return 1;
+
+    int prod_fd = -1;
+    for (int attempt = 0; attempt < 100 && prod_fd < 0; attempt++) {
+        prod_fd = connect_loopback(prod_port);
+        if (prod_fd < 0) std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (prod_fd < 0) {
+        std::cerr << "Broker did not come up on port " << prod_port << std::endl;
+        kill(broker.pid, SIGKILL); reap(broker);
+        return 1;
+    }
+
+    std::vector<Child> consumers;
+    int generation = 0;
+    auto start_consumer = [&](int slot) {
+        Child c;
+        c.name = "consumer-" + std::to_string(slot) + "." + std::to_string(generation++);
+        std::vector<std::string> args = {consumer_bin, "--connect", "127.0.0.1", std::to_string(cons_port)};
+        if (cfg.shm) args = {consumer_bin, "--shm", "broker.sock"};
+        args.insert(args.end(), cfg.consumer_args.begin(), cfg.consumer_args.end());
+        if (cfg.low_latency) {
+            // Core 0 is the broker's unless it is the only one; a restarted consumer takes
+            // its slot's core again
+            unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+            args.push_back("--low-latency");
+            args.push_back(std::to_string(cores > 1 ? 1 + slot % (cores - 1) : 0));
+        }
+        if (cfg.trace_sample) {
+            args.insert(args.end(), {"--trace-sample", std::to_string(cfg.trace_sample), "--trace-out", c.name + ".trace.json"});
+        }
+        args.push_back("--latency-out");
+        args.push_back(c.name + ".lat");
+        c.pid = spawn(run_dir, c.name + ".out", args);
+        consumers.push_back(c);
+        return consumers.size() - 1;
+    };
+    for (int i = 0; i < cfg.consumers; i++) start_consumer(i);
+
+    // Kill/restart bookkeeping, checked from both the send loop and the wait loop
+    size_t victim = 0;
+    long long kill_ms = -1, restart_ms = -1;
+    long long t_start = now_ns();
+    auto elapsed_ms = [&]() { return (now_ns() - t_start) / 1000000; };
+    auto tick_fault = [&]() {
+        if (cfg.kill_after_ms <= 0) return;
+        long long ms = elapsed_ms();
+        if (kill_ms < 0 && ms >= cfg.kill_after_ms) {
+            kill(consumers[victim].pid, SIGKILL);
+            reap(consumers[victim]);
+            kill_ms = ms;
+            std::cerr << "Killed " << consumers[victim].name << " at " << ms << " ms" << std::endl;
+        } else if (kill_ms >= 0 && restart_ms < 0 && ms >= kill_ms + cfg.restart_delay_ms) {
+            size_t idx = start_consumer(0);
+            restart_ms = ms;
+            std::cerr << "Restarted as " << consumers[idx].name << " at " << ms << " ms" << std::endl;
+        }
+    };
+
+    // ACK timeline, sampled every SAMPLE_MS from the send loop as well as the wait loop so
+    // that a kill during the send phase has samples on both sides of it
+    const long long SAMPLE_MS = 100;
+    std::vector<std::pair<long long, long long>> timeline;
+    long long acked = 0;
+    long long next_sample_ms = 0;
+    auto sample_acked = [&]() {
+        if (elapsed_ms() < next_sample_ms) return;
+        long long a = query_status(mon_port, "total_acked");
+        long long ms = elapsed_ms();
+        next_sample_ms = ms + SAMPLE_MS;
+        if (a >= 0) {
+            acked = a;
+            timeline.push_back({ms, acked});
+        }
+    };
+
+    std::vector<long long> send_ns(cfg.count, 0);
+    long long interval_ns = cfg.rate > 0 ? 1000000000LL / cfg.rate : 0;
+    long sent = 0;
+    long long bytes_sent = 0;
+    for (size_t u = 0; u < units.size(); u++) {
+        if (interval_ns > 0) {
+            long long target = t_start + sent * interval_ns;
+            long long ahead = target - now_ns();
+            if (ahead > 50000) std::this_thread::sleep_for(std::chrono::nanoseconds(ahead));
+        }
+        long long t = now_ns();
+        long n = std::min(per_unit, cfg.count - sent);
+        for (long k = 0; k < n; k++) send_ns[sent + k] = t;
+        if (send_all(prod_fd, units[u].data(), units[u].size()) != 0) {
+            std::cerr << "Send to broker failed after " << sent << " messages" << std::endl;
+            break;
+        }
+        if (Trace::enabled()) {
+            long long t_end = now_ns();
+            for (long k = 0; k < n; k++) {
+                if (Trace::sampled(sent + k + 1)) Trace::span("loadtest.send", sent + k + 1, t, t_end);
+            }
+        }
+        sent += n;
+        bytes_sent += static_cast<long long>(units[u].size());
+        tick_fault();
+        sample_acked();
+    }
+    close(prod_fd);
+    long long t_sent = now_ns();
+
+    // Poll the broker until every message is ACKed
+    while (true) {
+        tick_fault();
+        sample_acked();
+        if (acked >= sent) break;
+        if (elapsed_ms() > cfg.timeout_s * 1000) {
+            std::cerr << "Timed out with " << acked << "/" << sent << " ACKed" << std::endl;
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(SAMPLE_MS));
+    }
+    long long t_done = now_ns();
+    // Deliveries requeued after their visibility timeout; the broker log only reports
+    // requeues on disconnect
+    long long timed_out = query_status(mon_port, "redelivered");
+
+    // Stopping the broker closes consumer sockets; consumers then flush and exit
+    kill(broker.pid, SIGTERM);
+    reap(broker);
+    for (auto& c : consumers) reap(c);
+    if (cfg.trace_sample) {
+        Trace::dump();
+        std::vector<std::string> names = {"loadtest", "broker"};
+        for (const auto& c : consumers) names.push_back(c.name);
+        size_t files = merge_traces(run_dir, names, run_dir + "/trace.json");
+        std::cerr << "Merged " << files << " trace files into " << run_dir << "/trace.json" << std::endl;
+    }
+    struct stat log_st{};
+    long long log_bytes = stat((run_dir + "/broker_log.txt").c_str(), &log_st) == 0 ? log_st.st_size : 0;
+    rusage self{};
+    getrusage(RUSAGE_SELF, &self);
+    double producer_cpu = rusage_seconds(self);
+
+    // Pair consumer completion records with send times; the last completion wins
+    std::unordered_map<long, long long> done_ns;
+    long long records = 0;
+    for (const auto& c : consumers) {
+        std::ifstream in(run_dir + "/" + c.name + ".lat");
+        long id; long long ns;
+        while (in >> id >> ns) {
+            records++;
+            if (id < 1 || id > sent) continue;
+            auto it = done_ns.find(id);
+            if (it == done_ns.end() || ns > it->second) done_ns[id] = ns;
+        }
+    }
+    std::vector<long long> lat;
+    lat.reserve(done_ns.size());
+    long long last_done = 0;
+    for (const auto& kv : done_ns) {
+        lat.push_back(kv.second - send_ns[kv.first - 1]);
+        last_done = std::max(last_done, kv.second);
+    }
+    std::sort(lat.begin(), lat.end());
+    long long end_ns = last_done > 0 ? last_done : t_done;
+    double duration_s = (end_ns - t_start) / 1e9;
+    double throughput = duration_s > 0 ? acked / duration_s : 0.0;
+    double send_rate = (t_sent - t_start) > 0 ? sent * 1e9 / (t_sent - t_start) : 0.0;
+    long long requeued = count_requeued(run_dir + "/broker.out") + std::max(timed_out, 0LL);
+    long long duplicates = records - static_cast<long long>(done_ns.size());
+    double consumers_cpu = 0.0;
+    for (const auto& c : consumers) consumers_cpu += c.cpu_s;
+
+    double before = 0, during = 0, after = 0;
+    if (kill_ms >= 0) {
+        long long end_ms = timeline.empty() ? 0 : timeline.back().first;
+        before = window_rate(timeline, 0, kill_ms);
+        during = window_rate(timeline, kill_ms, restart_ms >= 0 ? restart_ms : end_ms);
+        after = restart_ms >= 0 ? window_rate(timeline, restart_ms, end_ms) : 0.0;
+    }
+
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    if (cfg.format == "csv") {
+        out << "consumers,count,rate,sent,acked,duration_s,send_rate,throughput,"
+            << "lat_p50_us,lat_p90_us,lat_p99_us,lat_p999_us,lat_max_us,"
+            << "requeued,duplicate_completions,cpu_producer_s,cpu_broker_s,cpu_consumers_s,"
+            << "kill_ms,restart_ms,tput_before_kill,tput_during_outage,tput_after_restart,"
+            << "batch,bytes_sent,bytes_per_msg,log_bytes,low_latency\n";
+        out << cfg.consumers << "," << cfg.count << "," << cfg.rate << "," << sent << "," << acked << ","
+            << duration_s << "," << send_rate << "," << throughput << ","
+            << percentile(lat, 0.50) << "," << percentile(lat, 0.90) << "," << percentile(lat, 0.99) << ","
+            << percentile(lat, 0.999) << "," << (lat.empty() ? 0.0 : lat.back() / 1000.0) << ","
+            << requeued << "," << duplicates << "," << producer_cpu << "," << broker.cpu_s << "," << consumers_cpu << ","
+            << kill_ms << "," << restart_ms << "," << before << "," << during << "," << after << ","
+            << cfg.batch << "," << bytes_sent << "," << (sent ? (double)bytes_sent / sent : 0.0) << "," << log_bytes << ","
+            << (cfg.low_latency ? 1 : 0) << "\n";
+    } else {
+        out << "{\n";
+        out << "  \"config\": {\"consumers\": " << cfg.consumers << ", \"count\": " << cfg.count
+            << ", \"rate\": " << cfg.rate << ", \"kill_after_ms\": " << cfg.kill_after_ms
+            << ", \"restart_delay_ms\": " << cfg.restart_delay_ms << ", \"batch\": " << cfg.batch
+            << ", \"low_latency\": " << (cfg.low_latency ? "true" : "false") << "},\n";
+        out << "  \"sent\": " << sent << ", \"acked\": " << acked << ",\n";
+        out << "  \"duration_s\": " << duration_s << ", \"send_rate\": " << send_rate
+            << ", \"throughput\": " << throughput << ",\n";
+        out << "  \"latency_us\": {\"samples\": " << lat.size() << ", \"p50\": " << percentile(lat, 0.50)
+            << ", \"p90\": " << percentile(lat, 0.90) << ", \"p99\": " << percentile(lat, 0.99)
+            << ", \"p999\": " << percentile(lat, 0.999) << ", \"max\": " << (lat.empty() ? 0.0 : lat.back() / 1000.0) << "},\n";
+        out << "  \"bytes\": {\"sent\": " << bytes_sent << ", \"per_msg\": " << (sent ? (double)bytes_sent / sent : 0.0)
+            << ", \"broker_log\": " << log_bytes << "},\n";
+        out << "  \"redelivery\": {\"requeued\": " << requeued << ", \"duplicate_completions\": " << duplicates << "},\n";
+        out << "  \"cpu_s\": {\"producer\": " << producer_cpu << ", \"broker\": " << broker.cpu_s
+            << ", \"consumers_total\": " << consumers_cpu << ", \"consumers\": {";
+        for (size_t i = 0; i < consumers.size(); i++) {
+            out << (i ? ", " : "") << "\"" << consumers[i].name << "\": " << consumers[i].cpu_s;
+        }
+        out << "}},\n";
+        out << "  \"recovery\": {\"kill_ms\": " << kill_ms << ", \"restart_ms\": " << restart_ms
+            << ", \"tput_before_kill\": " << before << ", \"tput_during_outage\": " << during
+            << ", \"tput_after_restart\": " << after << "},\n";
+        out << "  \"timeline\": [";
+        for (size_t i = 0; i < timeline.size(); i++) {
+            out << (i ? ", " : "") << "[" << timeline[i].first << ", " << timeline[i].second << "]";
+        }
+        out << "]\n}\n";
+    }
+
+    if (cfg.out_path.empty()) {
+        std::cout << out.str();
+    } else {
+        std::ofstream f(cfg.out_path);
+        f << out.str();
+        std::cerr << "Report written to " << cfg.out_path << std::endl;
+    }
+
+    if (cfg.keep_dir) {
+        std::cerr << "Child logs kept in " << run_dir << std::endl;
+    } else {
+        std::string cmd = "rm -rf '" + run_dir + "'";
+        if (std::system(cmd.c_str()) != 0) std::cerr << "Could not remove " << run_dir << std::endl;
+    }
+    return acked >= sent ? 0 : 1;
+}
@@ -0,0 +1,105 @@
+#include "dataset.h"
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char DATASET_MAGIC[8] = {'T', 'X', 'D', 'S', 'E', 'T', '0', '1'};
+
+struct DatasetHeader {
+    char magic[8];
+    uint64_t count;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t index_offset;
+    uint64_t reserved[3];
+};
+static const size_t INDEX_ENTRY_BYTES = 16;   // u64 offset + i64 time
+
+DatasetWriter::~DatasetWriter() {
+    if (file_) std::fclose(file_);
+}
+
+bool DatasetWriter::open(const std::string& path) {
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return false;
+    // Large buffer: the data section is written sequentially in big chunks
+    std::setvbuf(file_, nullptr, _IOFBF, 1 << 20);
+    DatasetHeader placeholder{};
+    return std::fwrite(&placeholder, sizeof(placeholder), 1, file_) == 1;
+}
+
+void DatasetWriter::append(const std::string& line, int64_t t_ns) {
+    index_.push_back({data_size_, t_ns});
+    std::fwrite(line.data(), 1, line.size(), file_);
+    std::fputc('\n', file_);
+    data_size_ += line.size() + 1;
+}
+
+bool DatasetWriter::close() {
+    if (!file_) return false;
+    DatasetHeader h{};
+    std::memcpy(h.magic, DATASET_MAGIC, sizeof(h.magic));
+    h.count = index_.size();
+    h.data_offset = sizeof(DatasetHeader);
+    h.data_size = data_size_;
+    h.index_offset = h.data_offset + data_size_;
+    bool ok = !std::ferror(file_);
+    for (const Entry& e : index_) {
+        ok = ok && std::fwrite(&e.offset, 8, 1, file_) == 1 && std::fwrite(&e.t_ns, 8, 1, file_) == 1;
+    }
+    ok = ok && std::fseek(file_, 0, SEEK_SET) == 0 && std::fwrite(&h, sizeof(h), 1, file_) == 1;
+    ok = (std::fclose(file_) == 0) && ok;
+    file_ = nullptr;
+    return ok;
+}
+
+DatasetReader::~DatasetReader() {
+    if (base_) munmap(base_, size_);
+}
+
+bool DatasetReader::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { perror("open dataset"); return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(DatasetHeader)) {
+        std::cerr << "Dataset too small: " << path << std::endl;
+        ::close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    base_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (base_ == MAP_FAILED) { base_ = nullptr; perror("mmap dataset"); return false; }
+
+    DatasetHeader h;
+    std::memcpy(&h, base_, sizeof(h));
+    if (std::memcmp(h.magic, DATASET_MAGIC, sizeof(h.magic)) != 0 ||
+        h.data_offset + h.data_size > size_ || h.index_offset + h.count * INDEX_ENTRY_BYTES > size_) {
+        std::cerr << "Not a valid dataset file: " << path << std::endl;
+        return false;
+    }
+    count_ = h.count;
+    data_ = static_cast<const char*>(base_) + h.data_offset;
+    data_size_ = h.data_size;
+    index_ = static_cast<const char*>(base_) + h.index_offset;
+    // Replay walks the file front to back exactly once
+    madvise(base_, size_, MADV_SEQUENTIAL);
+    madvise(base_, size_, MADV_WILLNEED);
+    return true;
+}
+
+uint64_t DatasetReader::offset(uint64_t i) const {
+    if (i >= count_) return data_size_;
+    uint64_t off;
+    std::memcpy(&off, index_ + i * INDEX_ENTRY_BYTES, 8);
+    return off;
+}
+
+int64_t DatasetReader::timeNs(uint64_t i) const {
+    int64_t t;
+    std::memcpy(&t, index_ + i * INDEX_ENTRY_BYTES + 8, 8);
+    return t;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Indexed binary dataset for reproducible producer runs.
+// Layout (little-endian):
+//   Header   magic "TXDSET01", record count, data offset/size, index offset
+//   Data     the serialized lines exactly as sent on the wire, '\n' included
+//   Index    per record: u64 offset into Data, i64 arrival time in ns since the first record
+// Replay mmaps the file and sends runs of records straight from the mapping, so the
+// bytes on the wire are identical to the recorded run and nothing is generated or copied.
+
+class DatasetWriter {
+public:
+    DatasetWriter() : file_(nullptr), data_size_(0) {}
+    ~DatasetWriter();
+
+    bool open(const std::string& path);
+    // line without the trailing newline; t_ns is relative to the first record
+    void append(const std::string& line, int64_t t_ns);
+    // Writes the index and header; returns false on any I/O error
+    bool close();
+    uint64_t count() const { return index_.size(); }
+
+private:
+    struct Entry { uint64_t offset; int64_t t_ns; };
+    std::FILE* file_;
+    uint64_t data_size_;
+    std::vector<Entry> index_;
+};
+
+class DatasetReader {
+public:
+    DatasetReader() : base_(nullptr), size_(0), count_(0), data_(nullptr), data_size_(0), index_(nullptr) {}
+    ~DatasetReader();
+
+    bool open(const std::string& path);
+
+    uint64_t count() const { return count_; }
+    uint64_t dataSize() const { return data_size_; }
+    // Records [i, j) are contiguous: start at record(i), span(i, j) bytes long
+    const char* record(uint64_t i) const { return data_ + offset(i); }
+    size_t span(uint64_t i, uint64_t j) const { return static_cast<size_t>(offset(j) - offset(i)); }
+    int64_t timeNs(uint64_t i) const;
+
+private:
+    uint64_t offset(uint64_t i) const;
+
+    void* base_;
+    size_t size_;
+    uint64_t count_;
+    const char* data_;
+    uint64_t data_size_;
+    const char* index_;
+};
@@ -1,7 +1,14 @@
 #include "../common/transaction.h"
 #include "../common/utils.h"
+#include "../common/batch_codec.h"
+#include "../common/clock.h"
+#include "../common/cluster_map.h"
+#include "../common/trace.h"
+#include "dataset.h"
 #include <iostream>
 #include <vector>
+#include <deque>
+#include <algorithm>
 #include <fstream>
 #include <string>
 #include <cstring>
@@ -10,7 +17,12 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
+#include <signal.h>
+#include <random>
+#include <thread>
+#include <chrono>
 
 static int send_all(int fd, const char* data, size_t len) {
     size_t total = 0;
@@ -22,15 +34,285 @@ static int send_all(int fd, const char* data, size_t len) {
     return 0;
 }
 
+struct Endpoint {
+    std::string host;
+    uint16_t port;
+};
+
+// Resolve and connect; returns the socket or -1
+static int connect_broker(const Endpoint& ep) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) { perror("socket"); return -1; }
+    
+    // Resolve hostname using getaddrinfo (supports both IP addresses and hostnames like "broker")
+    struct addrinfo hints{}, *result;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    std::string port_str = std::to_string(ep.port);
+    
+    int rv = getaddrinfo(ep.host.c_str(), port_str.c_str(), &hints, &result);
+    if (rv != 0) {
+        std::cerr << "getaddrinfo failed: " << gai_strerror(rv) << std::endl;
+        close(sockfd);
+        return -1;
+    }
+    
+    if (connect(sockfd, result->ai_addr, result->ai_addrlen) < 0) {
+        perror("connect");
+        freeaddrinfo(result);
+        close(sockfd);
+        return -1;
+    }
+    
+    freeaddrinfo(result);
+    return sockfd;
+}
+
+// After losing the broker, cycle through the other endpoints (standbys) for a while
+static int reconnect_broker(const std::vector<Endpoint>& endpoints, size_t& current) {
+    for (int round = 0; round < 50; round++) {
+        for (size_t k = 1; k <= endpoints.size(); k++) {
+            size_t idx = (current + k) % endpoints.size();
+            int fd = connect_broker(endpoints[idx]);
+            if (fd >= 0) {
+                current = idx;
+                std::cout << "Reconnected to broker at " << endpoints[idx].host << ":" << endpoints[idx].port << std::endl;
+                return fd;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    return -1;
+}
+
+// Publisher confirms: every unit (line or batch frame) gets the next sequence number and
+// stays in the window until the broker confirms it durable. Confirms are cumulative
+// ("C <seq>"), so the producer pipelines up to `limit` units without a round trip each.
+struct ConfirmWindow {
+    uint64_t producer_id;
+    size_t limit;
+    uint64_t next_seq;
+    std::deque<std::pair<uint64_t, std::string>> unconfirmed;
+    std::string inbuf;
+    uint64_t resent;
+};
+
+// Nothing at all from the broker for this long: treat it as gone. The broker repeats its
+// last confirm every second while idle, so a broker that is paused or slow to log stays alive.
+static const int CONFIRM_TIMEOUT_MS = 5000;
+
+// Read confirms and drop confirmed units from the window. With wait, block until
+// something arrives; any bytes count, including a repeated confirm. Returns false if
+// the connection is lost or stays silent.
+static bool read_confirms(int fd, ConfirmWindow& w, bool wait) {
+    pollfd pfd = {fd, POLLIN, 0};
+    int rv = poll(&pfd, 1, wait ? CONFIRM_TIMEOUT_MS : 0);
+    if (rv < 0) return false;
+    if (rv == 0) return !wait;
+    char buf[4096];
+    ssize_t n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+    if (n <= 0) return false;
+    w.inbuf.append(buf, n);
+    size_t pos;
+    while ((pos = w.inbuf.find('\n')) != std::string::npos) {
+        if (w.inbuf.compare(0, 2, "C ") == 0) {
+            uint64_t seq = std::stoull(w.inbuf.substr(2, pos - 2));
+            while (!w.unconfirmed.empty() && w.unconfirmed.front().first <= seq) w.unconfirmed.pop_front();
+        }
+        w.inbuf.erase(0, pos + 1);
+    }
+    return true;
+}
+
+// Announce the confirm session and the first unconfirmed sequence, then resend the
+// window. The broker drops any of these it had already logged.
+static bool start_confirm_session(int fd, ConfirmWindow& w) {
+    uint64_t first = w.unconfirmed.empty() ? w.next_seq : w.unconfirmed.front().first;
+    std::string hello = "CONFIRM " + std::to_string(w.producer_id) + " " + std::to_string(first) + "\n";
+    w.inbuf.clear();
+    if (send_all(fd, hello.data(), hello.size()) != 0) return false;
+    for (const auto& unit : w.unconfirmed) {
+        if (send_all(fd, unit.second.data(), unit.second.size()) != 0) return false;
+        w.resent++;
+    }
+    return true;
+}
+
+// Reconnect (to the same broker if it is the only endpoint) and resume the session
+static int resume_confirm_session(const std::vector<Endpoint>& endpoints, size_t& current, int fd, ConfirmWindow& w) {
+    if (fd >= 0) close(fd);
+    for (int attempt = 0; attempt < 3; attempt++) {
+        fd = reconnect_broker(endpoints, current);
+        if (fd < 0) return -1;
+        if (start_confirm_session(fd, w)) return fd;
+        close(fd);
+    }
+    return -1;
+}
+
+// One broker the producer streams to (a shard, or the only broker): its endpoints
+// (primary first, then standbys), the live socket, the confirm window and, with
+// --batch, the indices of transactions waiting for the next batch
+struct BrokerLink {
+    std::string name;
+    std::vector<Endpoint> endpoints;
+    size_t current;
+    int fd;
+    ConfirmWindow window;
+    std::vector<size_t> batch;
+    uint64_t sent;
+
+    BrokerLink() : current(0), fd(-1), sent(0) {}
+};
+
+// Send one unit, failing over to the link's standbys; in confirm mode the unit stays
+// in the window until confirmed and is resent with it after a reconnect
+static bool send_unit(BrokerLink& link, const std::string& unit) {
+    ConfirmWindow& window = link.window;
+    if (window.limit > 0) {
+        // Wait for room in the window
+        while (link.fd >= 0 && window.unconfirmed.size() >= window.limit && !read_confirms(link.fd, window, true)) {
+            link.fd = resume_confirm_session(link.endpoints, link.current, link.fd, window);
+        }
+        window.unconfirmed.emplace_back(window.next_seq++, unit);
+        // Confirms are only collected once the window is half full, not after every unit
+        bool collect = window.unconfirmed.size() * 2 >= window.limit;
+        if (link.fd >= 0 && (send_all(link.fd, unit.c_str(), unit.size()) != 0 ||
+                             (collect && !read_confirms(link.fd, window, false)))) {
+            link.fd = resume_confirm_session(link.endpoints, link.current, link.fd, window);
+        }
+        return link.fd >= 0;
+    }
+    if (send_all(link.fd, unit.c_str(), unit.size()) == 0) return true;
+    close(link.fd);
+    link.fd = link.endpoints.size() > 1 ? reconnect_broker(link.endpoints, link.current) : -1;
+    return link.fd >= 0 && send_all(link.fd, unit.c_str(), unit.size()) == 0;
+}
+
+// Stream a recorded dataset straight from its mapping. speed > 0 keeps the recorded
+// inter-arrival times scaled by 1/speed; speed 0 sends as fast as the socket takes it.
+// Records that are already due go out together in one send of up to MAX_CHUNK bytes.
+static int replay_dataset(const DatasetReader& ds, const std::vector<Endpoint>& endpoints, double speed) {
+    const size_t MAX_CHUNK = 256 * 1024;
+    size_t current = 0;
+    int sockfd = connect_broker(endpoints[0]);
+    if (sockfd < 0) return 1;
+    std::cout << "Connected. Replaying " << ds.count() << " transactions ("
+              << (speed > 0 ? std::to_string(speed) + "x recorded timing" : std::string("unpaced")) << ")..." << std::endl;
+
+    const uint64_t n = ds.count();
+    const int64_t start = Clock::monotonicNs();
+    auto due = [&](uint64_t i) { return start + static_cast<int64_t>(ds.timeNs(i) / speed); };
+    uint64_t i = 0;
+    uint64_t bytes_sent = 0;
+    while (i < n) {
+        if (speed > 0) {
+            int64_t ahead = due(i) - Clock::monotonicNs();
+            if (ahead > 0) std::this_thread::sleep_for(std::chrono::nanoseconds(ahead));
+        }
+        int64_t now = Clock::monotonicNs();
+        uint64_t j = i + 1;
+        while (j < n && ds.span(i, j + 1) <= MAX_CHUNK && (speed <= 0 || due(j) <= now)) j++;
+
+        if (send_all(sockfd, ds.record(i), ds.span(i, j)) != 0) {
+            close(sockfd);
+            sockfd = endpoints.size() > 1 ? reconnect_broker(endpoints, current) : -1;
+            if (sockfd < 0 || send_all(sockfd, ds.record(i), ds.span(i, j)) != 0) {
+                std::cerr << "Failed to send transaction." << std::endl; break;
+            }
+        }
+        bytes_sent += ds.span(i, j);
+        if (j / 100000 != i / 100000) {
+            std::cout << "Sent " << j << " transactions..." << std::endl;
+        }
+        i = j;
+    }
+    if (sockfd >= 0) close(sockfd);
+
+    double secs = (Clock::monotonicNs() - start) / 1e9;
+    std::cout << "\nReplayed " << i << " transactions (" << bytes_sent << " bytes) in " << secs << " s, "
+              << (secs > 0 ? i / secs : 0.0) << " tx/s" << std::endl;
+    return i == n ? 0 : 1;
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "=== Fault-Tolerant Distributed Producer ===" << std::endl;
     
+    // Positional: [host port [delay_ms]]; then --failover HOST:PORT (repeatable), --batch N,
+    // --confirm N, --cluster MAP, --record FILE, --replay FILE, --speed X,
+    // --trace-sample N, --trace-out FILE
+    std::vector<std::string> positional;
+    std::vector<Endpoint> endpoints;
+    size_t batch_size = 0;   // 0 = one text line per transaction
+    size_t confirm_window = 0;  // 0 = fire and forget; else max unconfirmed units
+    ClusterMap cluster;       // empty = single broker from the positional arguments
+    std::string record_path;  // write the generated dataset (and send times) here
+    std::string replay_path;  // stream this dataset instead of generating one
+    double speed = 1.0;       // replay time scale; 0 = unpaced
+    uint64_t trace_sample = 0;  // trace 1 in N transactions, 0 = off
+    std::string trace_path = "producer.trace.json";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) { record_path = argv[++i]; continue; }
+        if (arg == "--replay" && i + 1 < argc) { replay_path = argv[++i]; continue; }
+        if (arg == "--speed" && i + 1 < argc) { speed = std::stod(argv[++i]); continue; }
+        if (arg == "--trace-sample" && i + 1 < argc) { trace_sample = std::stoull(argv[++i]); continue; }
+        if (arg == "--trace-out" && i + 1 < argc) { trace_path = argv[++i]; continue; }
+        if (arg == "--batch" && i + 1 < argc) {
+            batch_size = static_cast<size_t>(std::stoul(argv[++i]));
+            continue;
+        }
+        if (arg == "--confirm" && i + 1 < argc) {
+            confirm_window = static_cast<size_t>(std::stoul(argv[++i]));
+            continue;
+        }
+        if (arg == "--cluster" && i + 1 < argc) {
+            std::string error;
+            if (!cluster.load(argv[++i], error)) { std::cerr << error << std::endl; return 1; }
+            continue;
+        }
+        if (arg == "--failover" && i + 1 < argc) {
+            std::string val = argv[++i];
+            size_t colon = val.rfind(':');
+            if (colon == std::string::npos) { std::cerr << "--failover expects HOST:PORT" << std::endl; return 1; }
+            endpoints.push_back({val.substr(0, colon), static_cast<uint16_t>(std::stoi(val.substr(colon + 1)))});
+            continue;
+        }
+        positional.push_back(arg);
+    }
+    
+    if (cluster.size() > 0 && (positional.size() >= 2 || !endpoints.empty())) {
+        // Standbys belong in the cluster map, under their shard's name
+        std::cerr << "--cluster replaces <broker_host> <broker_port> and --failover" << std::endl;
+        return 1;
+    }
+    if (!record_path.empty() && batch_size > 0) {
+        // A dataset holds text lines; a replay of it would not send the frames measured here
+        std::cerr << "--batch cannot be combined with --record" << std::endl;
+        return 1;
+    }
+
     // Check for delay parameter
     int delay_ms = 0;  // Default: no delay
-    if (argc >= 4) {
-        delay_ms = std::stoi(argv[3]);
+    if (positional.size() >= 3) {
+        delay_ms = std::stoi(positional[2]);
         std::cout << "Delay between messages: " << delay_ms << "ms" << std::endl;
     }
+
+    // Replay: nothing to generate, the dataset already holds the exact wire bytes
+    if (!replay_path.empty()) {
+        if (positional.size() < 2) { std::cerr << "--replay needs <broker_host> <broker_port>" << std::endl; return 1; }
+        if (batch_size > 0) { std::cerr << "--batch cannot be combined with --replay" << std::endl; return 1; }
+        if (confirm_window > 0) { std::cerr << "--confirm cannot be combined with --replay" << std::endl; return 1; }
+        if (cluster.size() > 0) { std::cerr << "--cluster cannot be combined with --replay" << std::endl; return 1; }
+        if (trace_sample > 0) { std::cerr << "--trace-sample cannot be combined with --replay" << std::endl; return 1; }
+        DatasetReader ds;
+        if (!ds.open(replay_path)) return 1;
+        endpoints.insert(endpoints.begin(), Endpoint{positional[0], static_cast<uint16_t>(std::stoi(positional[1]))});
+        std::cout << "Connecting to broker at " << positional[0] << ":" << positional[1] << " ..." << std::endl;
+        signal(SIGPIPE, SIG_IGN);
+        return replay_dataset(ds, endpoints, speed);
+    }
     
     std::cout << "Generating sample transactions..." << std::endl;
     
@@ -59,67 +341,205 @@ int main(int argc, char* argv[]) {
                   << ", Valid: " << (t.isValid() ? "YES" : "NO") << std::endl;
     }
 
-    // If host and port are provided, stream to socket instead of file
-    if (argc >= 3) {
-        std::string host = argv[1];
-        uint16_t port = static_cast<uint16_t>(std::stoi(argv[2]));
-        std::cout << "Connecting to broker at " << host << ":" << port << " ..." << std::endl;
-        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) { perror("socket"); return 1; }
-        
-        // Resolve hostname using getaddrinfo (supports both IP addresses and hostnames like "broker")
-        struct addrinfo hints{}, *result;
-        hints.ai_family = AF_INET;
-        hints.ai_socktype = SOCK_STREAM;
-        std::string port_str = std::to_string(port);
-        
-        int rv = getaddrinfo(host.c_str(), port_str.c_str(), &hints, &result);
-        if (rv != 0) {
-            std::cerr << "getaddrinfo failed: " << gai_strerror(rv) << std::endl;
-            close(sockfd);
-            return 1;
+    // If host and port (or a cluster map) are provided, stream to the broker(s) instead of a file
+    if (positional.size() >= 2 || cluster.size() > 0) {
+        std::vector<BrokerLink> links;
+        if (cluster.size() > 0) {
+            for (size_t s = 0; s < cluster.size(); s++) {
+                BrokerLink link;
+                link.name = cluster.shard(s).name;
+                for (const BrokerAddr& b : cluster.shard(s).brokers) link.endpoints.push_back({b.host, b.producer_port});
+                links.push_back(link);
+            }
+        } else {
+            BrokerLink link;
+            link.name = "broker";
+            link.endpoints = endpoints;
+            link.endpoints.insert(link.endpoints.begin(), Endpoint{positional[0], static_cast<uint16_t>(std::stoi(positional[1]))});
+            links.push_back(link);
         }
-        
-        if (connect(sockfd, result->ai_addr, result->ai_addrlen) < 0) {
-            perror("connect");
-            freeaddrinfo(result);
-            close(sockfd);
+        // A dead broker must surface as a send error we can fail over from, not a signal
+        signal(SIGPIPE, SIG_IGN);
+        std::random_device rd;
+        for (BrokerLink& link : links) {
+            std::cout << "Connecting to " << link.name << " at " << link.endpoints[0].host << ":" << link.endpoints[0].port << " ..." << std::endl;
+            link.current = 0;
+            link.fd = connect_broker(link.endpoints[0]);
+            if (link.fd < 0) return 1;
+            link.window.producer_id = (static_cast<uint64_t>(rd()) << 32) | rd();
+            link.window.limit = confirm_window;
+            link.window.next_seq = 1;
+            link.window.resent = 0;
+            if (confirm_window > 0 && !start_confirm_session(link.fd, link.window)) {
+                std::cerr << "Failed to start confirm session." << std::endl;
+                return 1;
+            }
+        }
+        std::cout << "Connected. Streaming transactions"
+                  << (links.size() > 1 ? " to " + std::to_string(links.size()) + " shards by card number" : std::string())
+                  << "..." << std::endl;
+
+        if (batch_size > 0) {
+            std::cout << "Sending columnar batches of " << batch_size << " transactions" << std::endl;
+        }
+        if (confirm_window > 0) {
+            std::cout << "Publisher confirms on: up to " << confirm_window << " unconfirmed units per broker" << std::endl;
+        }
+        Trace::configure(trace_sample, "producer", Trace::FIRST, trace_path);
+        if (Trace::enabled()) {
+            std::cout << "Tracing 1 in " << trace_sample << " transactions to " << trace_path << std::endl;
+        }
+
+        DatasetWriter recorder;
+        if (!record_path.empty() && !recorder.open(record_path)) {
+            std::cerr << "Error: Could not open " << record_path << " for recording" << std::endl;
             return 1;
         }
-        
-        freeaddrinfo(result);
-        std::cout << "Connected. Streaming transactions..." << std::endl;
-
-        char ackbuf[16];
-        int count = 0;
-        for (const auto& t : transactions) {
-            std::string line = t.serialize();
-            line.push_back('\n');
-            if (send_all(sockfd, line.c_str(), line.size()) != 0) {
-                std::cerr << "Failed to send transaction." << std::endl; break;
-            }
+
+        // One unit is either a text line or a framed batch; a unit that fails is resent whole after failover
+        size_t count = 0;
+        uint64_t bytes_sent = 0;
+        int64_t t0 = -1;   // send time of the first recorded unit
+        auto ship = [&](BrokerLink& link, const std::string& unit, const size_t* idx, size_t n) {
+            if (!send_unit(link, unit)) return false;
             // Don't wait for ACK - send as fast as possible
             // The broker will buffer and the TCP flow control will handle backpressure
-            
-            count++;
-            if (count % 10000 == 0) {
-                std::cout << "Sent " << count << " transactions..." << std::endl;
+            bytes_sent += unit.size();
+            link.sent += n;
+            if (!record_path.empty()) {
+                // Record when each transaction actually went out, for faithful replay
+                int64_t now = Clock::monotonicNs();
+                if (t0 < 0) t0 = now;
+                int64_t t = now - t0;
+                for (size_t k = 0; k < n; k++) recorder.append(transactions[idx[k]].serialize(), t);
+            }
+            for (size_t k = 0; k < n; k++) {
+                if (++count % 10000 == 0) {
+                    std::cout << "Sent " << count << " transactions..." << std::endl;
+                }
             }
-            
             // Add delay if specified
             if (delay_ms > 0) {
                 usleep(delay_ms * 1000);  // Convert ms to microseconds
             }
+            return true;
+        };
+        // A batch holds one shard's share of the stream; with a single broker it is a
+        // contiguous range and is encoded in place
+        std::vector<Transaction> scratch;
+        std::vector<uint64_t> traced;   // sampled transactions of the batch being shipped
+        auto ship_batch = [&](BrokerLink& link) {
+            const std::vector<size_t>& idx = link.batch;
+            if (Trace::enabled()) {
+                traced.clear();
+                for (size_t i : idx) {
+                    if (Trace::sampled(transactions[i].transaction_id)) traced.push_back(transactions[i].transaction_id);
+                }
+            }
+            int64_t encode_ns = Trace::enabled() && !traced.empty() ? Clock::monotonicNs() : 0;
+            int64_t send_ns = 0;
+            bool ok = true;
+            // The broker takes frames of up to MAX_BATCH_BYTES: halve the batch until each
+            // piece fits, and send a transaction too big even on its own as a text line
+            size_t done = 0, step = idx.size();
+            while (ok && done < idx.size()) {
+                size_t n = std::min(step, idx.size() - done);
+                const size_t* part = idx.data() + done;
+                std::string payload;
+                if (part[n - 1] - part[0] + 1 == n) {
+                    payload = BatchCodec::encode(transactions, part[0], part[n - 1] + 1);
+                } else {
+                    scratch.clear();
+                    for (size_t k = 0; k < n; k++) scratch.push_back(transactions[part[k]]);
+                    payload = BatchCodec::encode(scratch, 0, scratch.size());
+                }
+                if (payload.size() > BatchCodec::MAX_BATCH_BYTES && n > 1) {
+                    step = (n + 1) / 2;
+                    continue;
+                }
+                if (!send_ns && encode_ns) send_ns = Clock::monotonicNs();
+                if (payload.size() > BatchCodec::MAX_BATCH_BYTES) {
+                    ok = ship(link, transactions[part[0]].serialize() + "\n", part, 1);
+                } else {
+                    ok = ship(link, BatchCodec::frame(payload), part, n);
+                }
+                done += n;
+            }
+            if (encode_ns) {
+                int64_t sent_ns = Clock::monotonicNs();
+                for (uint64_t id : traced) {
+                    Trace::span("producer.encode", id, encode_ns, send_ns);
+                    Trace::span("producer.send", id, send_ns, sent_ns);
+                }
+            }
+            link.batch.clear();
+            return ok;
+        };
+
+        bool failed = false;
+        for (size_t i = 0; i < transactions.size() && !failed; i++) {
+            BrokerLink& link = links[links.size() > 1 ? cluster.shardFor(transactions[i].card_number) : 0];
+            if (batch_size > 0) {
+                link.batch.push_back(i);
+                if (link.batch.size() >= batch_size) failed = !ship_batch(link);
+            } else {
+                uint64_t trace_id = transactions[i].transaction_id;
+                TraceSpan serialize_span("producer.serialize", trace_id);
+                std::string unit = transactions[i].serialize();
+                unit.push_back('\n');
+                serialize_span.end();
+                TraceSpan send_span("producer.send", trace_id);
+                failed = !ship(link, unit, &i, 1);
+            }
         }
+        for (BrokerLink& link : links) {
+            if (!failed && !link.batch.empty()) failed = !ship_batch(link);
+        }
+        if (failed) std::cerr << "Failed to send transaction." << std::endl;
 
-        close(sockfd);
-        std::cout << "\nFinished streaming " << numTransactions << " transactions to socket." << std::endl;
+        bool unconfirmed = false;
+        for (BrokerLink& link : links) {
+            if (confirm_window > 0) {
+                // Done only once the broker has everything on disk
+                ConfirmWindow& window = link.window;
+                while (link.fd >= 0 && !window.unconfirmed.empty()) {
+                    if (!read_confirms(link.fd, window, true)) link.fd = resume_confirm_session(link.endpoints, link.current, link.fd, window);
+                }
+                std::cout << link.name << ": confirmed " << (window.next_seq - 1 - window.unconfirmed.size()) << " units, "
+                          << window.resent << " resent after reconnects" << std::endl;
+                if (!window.unconfirmed.empty()) {
+                    std::cerr << link.name << ": " << window.unconfirmed.size() << " units were never confirmed" << std::endl;
+                    unconfirmed = true;
+                }
+            }
+            if (links.size() > 1) std::cout << link.name << ": " << link.sent << " transactions" << std::endl;
+            if (link.fd >= 0) close(link.fd);
+        }
+        if (!record_path.empty()) {
+            if (!recorder.close()) { std::cerr << "Error writing " << record_path << std::endl; return 1; }
+            std::cout << "Recorded " << recorder.count() << " transactions to " << record_path << std::endl;
+        }
+        std::cout << "\nFinished streaming " << count << " transactions to socket ("
+                  << bytes_sent << " bytes, " << (count ? (double)bytes_sent / count : 0.0) << " per transaction)." << std::endl;
+        if (unconfirmed) return 1;
+    } else if (!record_path.empty()) {
+        // Record only: nothing was sent, so there are no arrival times and replay is unpaced
+        DatasetWriter recorder;
+        if (!recorder.open(record_path)) {
+            std::cerr << "Error: Could not open " << record_path << " for recording" << std::endl;
+            return 1;
+        }
+        for (size_t i = 0; i < transactions.size(); i++) {
+            recorder.append(transactions[i].serialize(), 0);
+        }
+        if (!recorder.close()) { std::cerr << "Error writing " << record_path << std::endl; return 1; }
+        std::cout << "\n" << recorder.count() << " transactions recorded to " << record_path << std::endl;
     } else {
-        // Default: Save to file
+        // Default: Save to file ('\n' rather than std::endl: one flush at close, not one per line)
         std::ofstream outFile("transactions.txt");
         if (outFile.is_open()) {
             for (const auto& t : transactions) {
-                outFile << t.serialize() << std::endl;
+                outFile << t.serialize() << '\n';
             }
             outFile.close();
             std::cout << "\n" << numTransactions << " transactions saved to transactions.txt" << std::endl;
@@ -0,0 +1,54 @@
+// Feature extraction and scoring for a card whose decayed average amount is 0
+#include "../consumer/card_cache.h"
+#include "../consumer/fraud_rules.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        std::cerr << "FAIL: " << what << std::endl;
+        failures++;
+    }
+}
+
+int main() {
+    RulePlan plan;
+    std::string error;
+    if (!plan.compile(RulePlan::DEFAULTS, "defaults", error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    Transaction t(1, "4111111111111111", 50.0, 7, "NYC");
+    CardFeatures zero_avg;
+    zero_avg.seen_before = true;
+    zero_avg.velocity = 2.0;
+
+    RuleInput in = RuleInput::from(t, zero_avg);
+    check(in.f[RuleInput::AMOUNT_RATIO] == 0.0, "amount_ratio is 0 for a seen card averaging 0");
+    check(std::isfinite(plan.score(in)), "score is finite for a seen card averaging 0");
+    CardFeatures steady = zero_avg;
+    steady.avg_amount = t.amount;
+    check(plan.score(in) == plan.score(RuleInput::from(t, steady)), "amount_ratio rule does not fire on a zero average");
+
+    RuleBatch batch;
+    batch.add(t, zero_avg);
+    double batch_score = 0.0;
+    plan.scoreBatch(batch, &batch_score);
+    check(batch.f[RuleInput::AMOUNT_RATIO][0] == 0.0, "batched amount_ratio is 0 for a seen card averaging 0");
+    check(batch_score == plan.score(in), "batched score matches the single score");
+
+    // The same state reached through the cache: only zero amounts on the card so far
+    CardCache cards(16, 60.0);
+    cards.observe("4111111111111111", 0.0, 1000000000LL);
+    CardFeatures seen = cards.observe("4111111111111111", 0.0, 2000000000LL);
+    check(seen.seen_before && seen.avg_amount == 0.0, "cache reports a seen card averaging 0");
+    check(RuleInput::from(t, seen).f[RuleInput::AMOUNT_RATIO] == 0.0, "amount_ratio from the cache is 0");
+
+    if (failures) return EXIT_FAILURE;
+    std::cout << "fraud_rules_test: ok" << std::endl;
+    return EXIT_SUCCESS;
+}